@@ -0,0 +1,461 @@
+#pragma once
+#include "Bytecode.hpp"
+#include <time.h>
+
+namespace CodeGeneratorNS {
+	BytecodeVM::BytecodeVM(const ASTreeNS::ASTree& tree){
+		collect_functions(tree.root());
+		start_function = find_function("_start");
+
+		for (size_t i = 0; i < functions.size(); ++i){
+			lower_function(functions[i]);
+		}
+	}
+
+	BytecodeVM::~BytecodeVM(){
+		delete [] stack;
+		delete [] frames;
+	}
+
+	void BytecodeVM::collect_functions(ASTreeNS::ASTNode_t* node){
+		if (node == nullptr) return;
+
+		if (node->key.code == Operator::DEC_FUNC){
+			functions.push_back({node->right()->key.lexem, node, 0, 0});
+		}
+
+		collect_functions(node->left());
+		collect_functions(node->right());
+	}
+
+	size_t BytecodeVM::find_function(const char* name){
+		for (size_t i = 0; i < functions.size(); ++i){
+			if (strcmp(functions[i].name, name) == 0) return i;
+		}
+
+		fprintf(stderr, "undefined Theurgy %s\n", name);
+		is_failed = true;
+
+		return 0;
+	}
+
+	// Register operands are 8-bit, a Theurgy whose Ideas and temporaries need more is not lowered.
+	bool BytecodeVM::is_out_of_registers(size_t num_regs, const char* name){
+		if (num_regs < Bytecode::MAX_REGS) return false;
+
+		if (!is_failed) fprintf(stderr, "Theurgy %s needs more than %zu bytecode registers\n", name, Bytecode::MAX_REGS);
+		is_failed = true;
+
+		return true;
+	}
+
+	bool BytecodeVM::is_ready(){
+		return !is_failed;
+	}
+
+	// Every Idea of a Theurgy gets its register before the temporaries, names of called Theurgies are not Ideas.
+	void BytecodeVM::collect_vars(ASTreeNS::ASTNode_t* node){
+		if (node == nullptr) return;
+
+		if (node->key.code == Operator::CALL){
+			collect_vars(node->left());
+			return;
+		}
+
+		if (node->key.type == TokenizerNS::ID){
+			for (size_t i = 0; i < num_vars; ++i){
+				if (strcmp(vars[i], node->key.lexem) == 0) return;
+			}
+
+			if (is_out_of_registers(num_vars, cur_name)) return;
+			vars[num_vars++] = node->key.lexem;
+		}
+
+		collect_vars(node->left());
+		collect_vars(node->right());
+	}
+
+	uint8_t BytecodeVM::var_register(const char* name){
+		for (size_t i = 0; i < num_vars; ++i){
+			if (strcmp(vars[i], name) == 0) return i;
+		}
+
+		assert("Idea was not collected" && false);
+		return 0;
+	}
+
+	uint8_t BytecodeVM::alloc_temp(){
+		if (is_out_of_registers(top, cur_name)) return 0;
+
+		if (top + 1 > max_regs) max_regs = top + 1;
+		return top++;
+	}
+
+	size_t BytecodeVM::emit(Bytecode::Op op, uint8_t a, uint8_t b, uint8_t c, int32_t imm){
+		code.push_back({nullptr, op, a, b, c, imm});
+		return code.size() - 1;
+	}
+
+	// True if the last instruction only loaded a constant from [min, max] into the temporary reg,
+	// the caller then replaces it with a superinstruction that takes the constant as an immediate.
+	bool BytecodeVM::is_temp_constant(uint8_t reg, int32_t min, int32_t max){
+		if (code.size() == 0 || reg < num_vars) return false;
+
+		Bytecode::Instruction& last = code[code.size() - 1];
+
+		return last.op == Bytecode::LOADI && last.a == reg && min <= last.imm && last.imm <= max;
+	}
+
+	void BytecodeVM::lower_function(Bytecode::Function& func){
+		num_vars = 0;
+		cur_name = func.name;
+
+		for (ASTreeNS::ASTNode_t* comma = func.node->left(); comma != nullptr && comma->right() != nullptr; comma = comma->left()){
+			if (is_out_of_registers(num_vars, cur_name)) return;
+			vars[num_vars++] = comma->right()->key.lexem;
+		}
+
+		ASTreeNS::ASTNode_t* body = func.node->right()->right();
+		collect_vars(body);
+
+		//value of a Ritual or Write statement, for Thanks
+		if (is_out_of_registers(num_vars, cur_name)) return;
+		last_value = num_vars;
+
+		top = max_regs = num_vars + 1;
+		last_assigned = -1;
+
+		func.entry = code.size();
+		lower_block(body);
+
+		//falling off the end returns 0
+		uint8_t zero = alloc_temp();
+		emit(Bytecode::LOADI, zero);
+		emit(Bytecode::RET, zero);
+
+		func.num_regs = max_regs;
+	}
+
+	void BytecodeVM::lower_block(ASTreeNS::ASTNode_t* node){
+		while (node != nullptr && node->right() != nullptr){
+			lower_operator(node->right());
+
+			node = node->left();
+		}
+	}
+
+	void BytecodeVM::lower_operator(ASTreeNS::ASTNode_t* node){
+		assert(node != nullptr);
+
+		size_t saved = top;
+
+		switch (node->key.code){
+		case Operator::IF:
+			lower_branching(node);
+			break;
+		case Operator::DEC_VAR:
+			emit(Bytecode::LOADI, var_register(node->right()->key.lexem));
+			break;
+		case Operator::ASSGN:
+			last_assigned = var_register(node->left()->key.lexem);
+			lower_into(node->right(), last_assigned);
+			break;
+		case Operator::RETURN:
+			emit(Bytecode::RET, operand(node->right()));
+			break;
+		case Operator::CALL:
+			last_assigned = last_value;
+			lower_call(node, last_value);
+			break;
+		case Operator::WRITE:
+			last_assigned = last_value;
+			lower_into(node->right(), last_value);
+			emit(Bytecode::WRITE, last_value);
+			break;
+		case Operator::READ:
+			emit(Bytecode::READ, var_register(node->right()->key.lexem));
+			break;
+		case Operator::EXIT:
+			if (last_assigned != -1){
+				emit(Bytecode::RET, last_assigned);
+				break;
+			}
+
+			emit(Bytecode::LOADI, alloc_temp());
+			emit(Bytecode::RET, top - 1);
+			break;
+		case Operator::SQRT: //no code is generated for it natively either
+			break;
+		default:
+			printf("Wrong operator %s\n", node->key.lexem);
+			break;
+		}
+
+		top = saved;
+	}
+
+	Bytecode::Op BytecodeVM::negated_jump(Operator::code code){
+		switch (code){
+			case Operator::EQL:    return Bytecode::JNE;
+			case Operator::NEQL:   return Bytecode::JEQ;
+			case Operator::LESS:   return Bytecode::JGE;
+			case Operator::MORE:   return Bytecode::JLE;
+			case Operator::EQLESS: return Bytecode::JGT;
+			case Operator::EQMORE: return Bytecode::JLT;
+
+			default:
+				assert("Wrong branching format" && false);
+				return Bytecode::JMP;
+		}
+	}
+
+	void BytecodeVM::lower_branching(ASTreeNS::ASTNode_t* node){
+		ASTreeNS::ASTNode_t* cond = node->left();
+		Bytecode::Op jump = negated_jump(cond->key.code);
+
+		size_t saved = top;
+
+		uint8_t lhs = operand(cond->left());
+		uint8_t rhs = operand(cond->right());
+
+		size_t to_else = 0;
+
+		if (is_temp_constant(rhs, INT16_MIN, INT16_MAX)){
+			uint16_t value = code[code.size() - 1].imm;
+			code.resize(code.size() - 1);
+
+			to_else = emit((Bytecode::Op)(jump - Bytecode::JEQ + Bytecode::JEQI), lhs, value & 0xFF, value >> 8);
+			++num_fused_branches;
+		}
+
+		else {
+			to_else = emit(jump, lhs, rhs);
+		}
+
+		top = saved;
+
+		lower_block(node->right()->right());
+
+		if (node->right()->left() == nullptr || node->right()->left()->right() == nullptr){
+			code[to_else].imm = code.size();
+			return;
+		}
+
+		size_t to_end = emit(Bytecode::JMP);
+		code[to_else].imm = code.size();
+
+		lower_block(node->right()->left());
+		code[to_end].imm = code.size();
+	}
+
+	uint8_t BytecodeVM::operand(ASTreeNS::ASTNode_t* node){
+		if (node->key.type == TokenizerNS::ID) return var_register(node->key.lexem);
+
+		uint8_t temp = alloc_temp();
+		lower_into(node, temp);
+
+		return temp;
+	}
+
+	void BytecodeVM::lower_into(ASTreeNS::ASTNode_t* node, uint8_t dst){
+		assert(node != nullptr);
+
+		if (node->key.type == TokenizerNS::NUM){
+			int64_t value = strtoll(node->key.lexem, nullptr, 10);
+
+			if (INT32_MIN <= value && value <= INT32_MAX){
+				emit(Bytecode::LOADI, dst, 0, 0, value);
+				return;
+			}
+
+			constants.push_back(value);
+			emit(Bytecode::LOADK, dst, 0, 0, constants.size() - 1);
+			return;
+		}
+
+		if (node->key.type == TokenizerNS::ID){
+			uint8_t src = var_register(node->key.lexem);
+			if (src != dst) emit(Bytecode::MOV, dst, src);
+
+			return;
+		}
+
+		if (node->key.code == Operator::CALL){
+			lower_call(node, dst);
+			return;
+		}
+
+		size_t saved = top;
+
+		uint8_t lhs = operand(node->left());
+		uint8_t rhs = operand(node->right());
+
+		lower_arithmetic(node->key.code, dst, lhs, rhs);
+
+		top = saved;
+	}
+
+	void BytecodeVM::lower_arithmetic(Operator::code oper, uint8_t dst, uint8_t lhs, uint8_t rhs){
+		Bytecode::Op op = Bytecode::ADD;
+
+		switch (oper){
+			case Operator::ADD: op = Bytecode::ADD; break;
+			case Operator::SUB: op = Bytecode::SUB; break;
+			case Operator::MUL: op = Bytecode::MUL; break;
+			case Operator::DIV: op = Bytecode::DIV; break;
+
+			default:
+				assert("Unknown operator code" && false);
+		}
+
+		if (op != Bytecode::DIV && is_temp_constant(rhs, INT32_MIN, INT32_MAX)){
+			int32_t value = code[code.size() - 1].imm;
+			code.resize(code.size() - 1);
+
+			emit((Bytecode::Op)(op - Bytecode::ADD + Bytecode::ADDI), dst, lhs, 0, value);
+			++num_fused_arithmetic;
+			return;
+		}
+
+		emit(op, dst, lhs, rhs);
+	}
+
+	// Arguments are evaluated into consecutive temporaries on top of the frame, which become
+	// the first registers of the callee's window.
+	void BytecodeVM::lower_call(ASTreeNS::ASTNode_t* node, uint8_t dst){
+		assert(node->key.code == Operator::CALL);
+
+		size_t base = top;
+		size_t num_args = 0;
+
+		for (ASTreeNS::ASTNode_t* comma = node->left(); comma != nullptr && comma->right() != nullptr; comma = comma->left()){
+			lower_into(comma->right(), alloc_temp());
+			++num_args;
+		}
+
+		emit(Bytecode::CALL, dst, base, num_args, find_function(node->right()->key.lexem));
+
+		top = base;
+	}
+
+	int64_t BytecodeVM::execute(size_t function){
+		static const void* const HANDLERS[] = {
+			&&op_mov, &&op_loadi, &&op_loadk,
+			&&op_add, &&op_sub, &&op_mul, &&op_div,
+			&&op_addi, &&op_subi, &&op_muli,
+			&&op_jmp,
+			&&op_jeq,  &&op_jne,  &&op_jlt,  &&op_jgt,  &&op_jle,  &&op_jge,
+			&&op_jeqi, &&op_jnei, &&op_jlti, &&op_jgti, &&op_jlei, &&op_jgei,
+			&&op_call, &&op_ret, &&op_write, &&op_read,
+		};
+
+		static_assert(sizeof(HANDLERS) / sizeof(HANDLERS[0]) == Bytecode::NUM_OPS, "Every op needs a handler");
+
+		if (!is_threaded){
+			for (size_t i = 0; i < code.size(); ++i) code[i].handler = HANDLERS[code[i].op];
+
+			stack  = new int64_t[Bytecode::STACK_SIZE];
+			frames = new Bytecode::Frame[Bytecode::MAX_DEPTH];
+			is_threaded = true;
+		}
+
+		const Bytecode::Instruction* base = &code[0];
+		const Bytecode::Instruction* pc = base + functions[function].entry;
+
+		int64_t* regs = stack;
+		size_t depth = 0;
+
+		if (functions[function].num_regs > Bytecode::STACK_SIZE) goto overflow;
+
+		#define DISPATCH() goto *pc->handler
+		#define NEXT()     do { ++pc; DISPATCH(); } while (0)
+		#define JUMP_IF(cond) do { pc = (cond)?(base + pc->imm):(pc + 1); DISPATCH(); } while (0)
+		#define IMM16()    ((int16_t)(pc->b | pc->c << 8))
+
+		DISPATCH();
+
+	op_mov:   regs[pc->a] = regs[pc->b];        NEXT();
+	op_loadi: regs[pc->a] = pc->imm;            NEXT();
+	op_loadk: regs[pc->a] = constants[pc->imm]; NEXT();
+
+	//wrapping like the native code, signed overflow would be undefined
+	op_add: regs[pc->a] = (uint64_t)regs[pc->b] + (uint64_t)regs[pc->c]; NEXT();
+	op_sub: regs[pc->a] = (uint64_t)regs[pc->b] - (uint64_t)regs[pc->c]; NEXT();
+	op_mul: regs[pc->a] = (uint64_t)regs[pc->b] * (uint64_t)regs[pc->c]; NEXT();
+	op_div: regs[pc->a] = regs[pc->b] / regs[pc->c]; NEXT();
+
+	op_addi: regs[pc->a] = (uint64_t)regs[pc->b] + (uint64_t)(int64_t)pc->imm; NEXT();
+	op_subi: regs[pc->a] = (uint64_t)regs[pc->b] - (uint64_t)(int64_t)pc->imm; NEXT();
+	op_muli: regs[pc->a] = (uint64_t)regs[pc->b] * (uint64_t)(int64_t)pc->imm; NEXT();
+
+	op_jmp: pc = base + pc->imm; DISPATCH();
+
+	op_jeq: JUMP_IF(regs[pc->a] == regs[pc->b]);
+	op_jne: JUMP_IF(regs[pc->a] != regs[pc->b]);
+	op_jlt: JUMP_IF(regs[pc->a] <  regs[pc->b]);
+	op_jgt: JUMP_IF(regs[pc->a] >  regs[pc->b]);
+	op_jle: JUMP_IF(regs[pc->a] <= regs[pc->b]);
+	op_jge: JUMP_IF(regs[pc->a] >= regs[pc->b]);
+
+	op_jeqi: JUMP_IF(regs[pc->a] == IMM16());
+	op_jnei: JUMP_IF(regs[pc->a] != IMM16());
+	op_jlti: JUMP_IF(regs[pc->a] <  IMM16());
+	op_jgti: JUMP_IF(regs[pc->a] >  IMM16());
+	op_jlei: JUMP_IF(regs[pc->a] <= IMM16());
+	op_jgei: JUMP_IF(regs[pc->a] >= IMM16());
+
+	op_call: {
+		const Bytecode::Function& callee = functions[pc->imm];
+
+		if (depth == Bytecode::MAX_DEPTH || regs + pc->b + callee.num_regs > stack + Bytecode::STACK_SIZE) goto overflow;
+
+		frames[depth++] = {pc + 1, regs, pc->a};
+		regs += pc->b;
+		pc = base + callee.entry;
+		DISPATCH();
+	}
+
+	op_ret: {
+		int64_t result = regs[pc->a];
+		if (depth == 0) return result;
+
+		const Bytecode::Frame& frame = frames[--depth];
+		regs = frame.regs;
+		regs[frame.dst] = result;
+		pc = frame.ret;
+		DISPATCH();
+	}
+
+	op_write: aristotle_write_num(regs[pc->a]); NEXT();
+	op_read:  regs[pc->a] = aristotle_read_num(); NEXT();
+
+	overflow:
+		fprintf(stderr, "bytecode stack overflow\n");
+		abort();
+
+		#undef DISPATCH
+		#undef NEXT
+		#undef JUMP_IF
+		#undef IMM16
+	}
+
+	int64_t BytecodeVM::run(){
+		timespec start = {}, end = {};
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		int64_t result = execute(start_function);
+		aristotle_flush();
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		run_us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+		return result;
+	}
+
+	void BytecodeVM::dump_stats(FILE* output_f){
+		assert(output_f != nullptr);
+
+		fprintf(output_f, "bytecode: %zu instructions, %zu bytes\n", code.size(), code.size() * sizeof(Bytecode::Instruction));
+		fprintf(output_f, "superinstructions: %zu compare and branch, %zu arithmetic\n", num_fused_branches, num_fused_arithmetic);
+		fprintf(output_f, "vm time: %.0f us\n", run_us);
+	}
+};
@@ -0,0 +1,122 @@
+#pragma once
+#include "../Lib/CompLib.hpp"
+#include "../Frontend/ASTree.cpp"
+#include "../Lib/Runtime.hpp"
+
+namespace CodeGeneratorNS {
+	namespace Bytecode {
+		enum Op : uint8_t {
+			MOV,   //a = b
+			LOADI, //a = imm
+			LOADK, //a = constants[imm]
+
+			ADD, SUB, MUL, DIV,    //a = b op c
+			ADDI, SUBI, MULI,      //a = b op imm, LOADI + op superinstructions
+
+			JMP,                            //pc = imm
+			JEQ, JNE, JLT, JGT, JLE, JGE,   //if (a cmp b) pc = imm
+			JEQI, JNEI, JLTI, JGTI, JLEI, JGEI, //if (a cmp (int16)(b | c << 8)) pc = imm, LOADI + Jcc superinstructions
+
+			CALL,  //a = functions[imm](registers b .. b + c - 1)
+			RET,   //return a
+			WRITE, //print a
+			READ,  //scan a
+
+			NUM_OPS
+		};
+
+		//handler is the address of the op's label in the dispatch loop, filled in before the first run
+		struct Instruction {
+			const void* handler;
+			Op op;
+			uint8_t a, b, c;
+			int32_t imm;
+		};
+
+		static_assert(sizeof(Instruction) == 16, "Instructions are meant to take 16 bytes");
+
+		struct Function {
+			const char* name;
+			ASTreeNS::ASTNode_t* node;
+			size_t entry;
+			size_t num_regs; //window the callee needs above its arguments' base
+		};
+
+		struct Frame {
+			const Instruction* ret;
+			int64_t* regs;
+			uint8_t dst;
+		};
+
+		constexpr size_t MAX_REGS   = 256;     //per function, registers are uint8_t
+		constexpr size_t STACK_SIZE = 1 << 20; //registers of all active frames
+		constexpr size_t MAX_DEPTH  = 1 << 16;
+	};
+
+	// Portable back end for hosts that forbid executable memory: Theurgies are lowered to a
+	// register bytecode where Ideas and arguments live in registers of a sliding window, so a
+	// call passes its arguments in place. The dispatch loop is direct threaded: every instruction
+	// holds the address of its handler and ends with a computed goto to the next one.
+	class BytecodeVM {
+	private:
+		Vector<Bytecode::Instruction> code;
+		Vector<int64_t> constants;
+		Vector<Bytecode::Function> functions;
+		size_t start_function = 0;
+		bool is_failed = false;
+
+		//lowering state of the current function
+		const char* cur_name = nullptr; //of the Theurgy being lowered
+		const char* vars[Bytecode::MAX_REGS] = {};
+		size_t num_vars = 0;
+		size_t top      = 0; //first free temporary
+		size_t max_regs = 0;
+		size_t last_value = 0;
+		int last_assigned = -1; //register Thanks returns
+
+		bool is_threaded = false;
+		size_t num_fused_branches   = 0;
+		size_t num_fused_arithmetic = 0;
+		double run_us = 0;
+
+		int64_t* stack = nullptr;
+		Bytecode::Frame* frames = nullptr;
+
+		void collect_functions(ASTreeNS::ASTNode_t* node);
+		void collect_vars(ASTreeNS::ASTNode_t* node);
+		size_t find_function(const char* name);
+
+		uint8_t var_register(const char* name);
+		uint8_t alloc_temp();
+		bool is_out_of_registers(size_t num_regs, const char* name);
+
+		size_t emit(Bytecode::Op op, uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, int32_t imm = 0);
+		bool   is_temp_constant(uint8_t reg, int32_t min, int32_t max);
+
+		void lower_function(Bytecode::Function& func);
+		void lower_block(ASTreeNS::ASTNode_t* node);
+		void lower_operator(ASTreeNS::ASTNode_t* node);
+		void lower_branching(ASTreeNS::ASTNode_t* node);
+		void lower_into(ASTreeNS::ASTNode_t* node, uint8_t dst);
+		void lower_call(ASTreeNS::ASTNode_t* node, uint8_t dst);
+		void lower_arithmetic(Operator::code oper, uint8_t dst, uint8_t lhs, uint8_t rhs);
+		uint8_t operand(ASTreeNS::ASTNode_t* node);
+
+		Bytecode::Op negated_jump(Operator::code code);
+
+		int64_t execute(size_t function);
+
+	public:
+		explicit BytecodeVM(const ASTreeNS::ASTree& tree);
+		~BytecodeVM();
+
+		BytecodeVM(const BytecodeVM&) = delete;
+		BytecodeVM& operator=(const BytecodeVM&) = delete;
+
+		//false if a Theurgy could not be lowered, _start included
+		bool is_ready();
+
+		int64_t run();
+		void dump_stats(FILE* output_f);
+	};
+};
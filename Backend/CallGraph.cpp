@@ -0,0 +1,186 @@
+#pragma once
+#include "CallGraph.hpp"
+
+namespace CodeGeneratorNS {
+	CallGraph::CallGraph(ASTreeNS::ASTNode_t* root){
+		assert(root != nullptr);
+
+		collect_functions(root);
+
+		for (auto& func: functions){
+			collect_calls(func.second->node->right()->right(), func.second);
+		}
+
+		for (auto& func: functions){
+			Vector<FuncInfo*> seen;
+			func.second->is_recursive = reaches(func.second, func.second, seen);
+		}
+	}
+
+	CallGraph::~CallGraph(){
+		for (auto& func: functions){
+			delete func.second->allocator;
+			delete func.second;
+		}
+	}
+
+	FuncInfo* CallGraph::find(const char* name){
+		auto found = functions.find(name);
+
+		return (found == functions.end())?(nullptr):(found->second);
+	}
+
+	void CallGraph::externals(Vector<const char*>& names){
+		for (auto& func: functions){
+			for (size_t i = 0; i < func.second->callees.size(); ++i){
+				if (find(func.second->callees[i]) == nullptr) names.push_back(func.second->callees[i]);
+			}
+		}
+	}
+
+	const Convention& CallGraph::convention(const char* name){
+		FuncInfo* func = find(name);
+
+		return (func == nullptr)?(standard):(func->conv);
+	}
+
+	size_t CallGraph::num_internal(){
+		size_t num = 0;
+
+		for (auto& func: functions){
+			if (!func.second->conv.is_standard) ++num;
+		}
+
+		return num;
+	}
+
+	void CallGraph::collect_functions(ASTreeNS::ASTNode_t* node){
+		if (node == nullptr) return;
+
+		if (node->key.code == Operator::DEC_FUNC){
+			FuncInfo* func = new FuncInfo();
+			func->node = node;
+
+			for (size_t i = 0; i < Linkage::EXPORTED_SIZE; ++i){
+				if (strcmp(node->right()->key.lexem, Linkage::EXPORTED[i]) == 0) func->is_exported = true;
+			}
+
+			functions[node->right()->key.lexem] = func;
+		}
+
+		collect_functions(node->left());
+		collect_functions(node->right());
+	}
+
+	void CallGraph::collect_calls(ASTreeNS::ASTNode_t* node, FuncInfo* caller){
+		if (node == nullptr) return;
+
+		if (node->key.code == Operator::CALL){
+			const char* callee = node->right()->key.lexem;
+			bool is_known = false;
+
+			for (size_t i = 0; i < caller->callees.size(); ++i){
+				if (strcmp(caller->callees[i], callee) == 0) is_known = true;
+			}
+
+			if (!is_known) caller->callees.push_back(callee);
+		}
+
+		collect_calls(node->left(),  caller);
+		collect_calls(node->right(), caller);
+	}
+
+	bool CallGraph::reaches(FuncInfo* from, FuncInfo* target, Vector<FuncInfo*>& seen){
+		for (size_t i = 0; i < seen.size(); ++i){
+			if (seen[i] == from) return false;
+		}
+
+		seen.push_back(from);
+
+		for (size_t i = 0; i < from->callees.size(); ++i){
+			FuncInfo* callee = find(from->callees[i]);
+			if (callee == nullptr) continue;
+
+			if (callee == target || reaches(callee, target, seen)) return true;
+		}
+
+		return false;
+	}
+
+	void CallGraph::visit(FuncInfo* func){
+		if (func->is_visited) return;
+		func->is_visited = true;
+
+		for (size_t i = 0; i < func->callees.size(); ++i){
+			FuncInfo* callee = find(func->callees[i]);
+			if (callee != nullptr) visit(callee);
+		}
+
+		order.push_back(func);
+	}
+
+	// Bottom-up over the call graph: every internal callee has its convention fixed
+	// before its callers are allocated. Recursive Theurgies fall back to System V.
+	void CallGraph::allocate(){
+		for (auto& func: functions){
+			visit(func.second);
+		}
+
+		for (size_t i = 0; i < order.size(); ++i){
+			allocate(order[i]);
+		}
+	}
+
+	// Lazy counterpart of allocate(): name and the Theurgies it can reach that are not allocated yet.
+	FuncInfo* CallGraph::allocate(const char* name){
+		FuncInfo* func = find(name);
+		if (func == nullptr) return nullptr;
+
+		size_t first = order.size();
+		visit(func);
+
+		for (size_t i = first; i < order.size(); ++i){
+			allocate(order[i]);
+		}
+
+		return func;
+	}
+
+	void CallGraph::allocate(FuncInfo* func){
+		assert(func != nullptr);
+
+		RegisterAllocator* allocator = new RegisterAllocator(func->node);
+		func->allocator = allocator;
+		func->conv.is_standard = func->is_exported || func->is_recursive;
+
+		if (!func->conv.is_standard) allocator->set_min_uses(Allocation::MIN_USES_INTERNAL);
+
+		for (size_t i = 0; i < allocator->num_calls(); ++i){
+			CallSite& site = allocator->call(i);
+			const Convention& callee = convention(site.callee);
+
+			memcpy(site.clobbers, callee.clobbers, sizeof(site.clobbers));
+		}
+
+		allocator->allocate();
+
+		if (func->conv.is_standard) return;
+
+		for (size_t i = 0; i < Allocation::POOL_SIZE; ++i){
+			func->conv.clobbers[i] = allocator->is_clobbered(i);
+		}
+
+		for (size_t i = 0; i < allocator->num_args() && i < Allocation::ARGUMENTS_SIZE; ++i){
+			LiveInterval& arg = (*allocator)[i];
+
+			if (arg.loc.reg != Assembly::Registers::NOT_REG){
+				arg.arg_reg = arg.loc.reg;
+				func->conv.args[i] = arg.loc.reg;
+			}
+
+			else if (arg.uses == 1){
+				func->conv.args[i] = Assembly::Registers::NOT_REG;
+			}
+		}
+	}
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include "../Lib/CompLib.hpp"
+#include "../Frontend/ASTree.cpp"
+#include "RegAlloc.cpp"
+
+namespace CodeGeneratorNS {
+	namespace Linkage {
+		constexpr const char* EXPORTED[] = {"_start"};
+		constexpr size_t EXPORTED_SIZE = sizeof(EXPORTED) / sizeof(EXPORTED[0]);
+
+		//runtime entry points the generated code calls
+		constexpr const char* WRITE_NUM = "_write_num";
+		constexpr const char* READ_NUM  = "_read_num";
+		constexpr const char* COUNT     = "_count";
+	};
+
+	//how a Theurgy is called: System V for exported and recursive ones, a custom one for the rest
+	struct Convention {
+		bool is_standard = true;
+
+		//register of each argument, NOT_REG for arguments the callee never reads
+		Assembly::Registers::Reg args[Allocation::ARGUMENTS_SIZE] = {
+			Assembly::Registers::RDI, Assembly::Registers::RSI, Assembly::Registers::RDX,
+			Assembly::Registers::RCX, Assembly::Registers::R8,  Assembly::Registers::R9,
+		};
+
+		bool clobbers[Allocation::POOL_SIZE] = {}; //callee-saved registers left modified
+	};
+
+	struct FuncInfo {
+		ASTreeNS::ASTNode_t* node = nullptr;
+		Vector<const char*> callees;
+
+		bool is_exported  = false;
+		bool is_recursive = false;
+		bool is_visited   = false;
+
+		Convention conv = {};
+		RegisterAllocator* allocator = nullptr;
+	};
+
+	class CallGraph {
+	private:
+		std::map<const char*, FuncInfo*, str_less> functions;
+		Vector<FuncInfo*> order; //callees first
+
+		Convention standard = {};
+
+		void collect_functions(ASTreeNS::ASTNode_t* node);
+		void collect_calls(ASTreeNS::ASTNode_t* node, FuncInfo* caller);
+		bool reaches(FuncInfo* from, FuncInfo* target, Vector<FuncInfo*>& seen);
+		void visit(FuncInfo* func);
+		void allocate(FuncInfo* func);
+
+	public:
+		explicit CallGraph(ASTreeNS::ASTNode_t* root);
+		~CallGraph();
+
+		void allocate();
+		FuncInfo* allocate(const char* name);
+
+		FuncInfo* find(const char* name);
+		void externals(Vector<const char*>& names); //called but not defined here
+		const Convention& convention(const char* name);
+		size_t num_internal();
+	};
+};
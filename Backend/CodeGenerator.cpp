@@ -1,19 +1,51 @@
+#pragma once
 #include "CodeGenerator.hpp"
 
 namespace CodeGeneratorNS {
-	CodeGenerator::CodeGenerator(const ASTreeNS::ASTree& tree){
+	// A lazy generator emits nothing up front, Theurgies are generated one at a time by generate_function.
+	// An instrumented one counts blocks and Ritual sites, a profile orders and places the arms of Criteria.
+	CodeGenerator::CodeGenerator(const ASTreeNS::ASTree& tree, bool is_lazy, bool is_instrumented, const OptimizerNS::Profile* profile):
+		is_instrumented(is_instrumented), profile(profile) {
 		cur	= tree.root();
-		instructions.push_back(new Assembly::Section(".text"));
-		//instructions.push_back(new Assembly::Array("num_format", "'%d', 10d, 0"));
-		//instructions.push_back(new Assembly::Extern("_vprintf"));
-		instructions.push_back(new Assembly::Global("_start"));
+
+		call_graph = new CallGraph(cur);
+
+		cfg      = new ControlFlowGraph(instructions, symbols);
+		peephole = new PeepholeOptimizer(instructions);
+
+		if (is_lazy) return;
+
+		call_graph->allocate();
+
 		generate_block(cur->right());
-		
+
+		cfg->run();
+		peephole->run();
+	}
+
+	// Replaces the code with a single Theurgy, calls to the others are left unresolved.
+	bool CodeGenerator::generate_function(const char* name){
+		assert(name != nullptr);
+
+		FuncInfo* func = call_graph->allocate(name);
+		if (func == nullptr) return false;
+
+		instructions.resize(0);
+		symbols.clear();
+
+		generate_func_declaration(func->node);
+
+		cfg->run();
+		peephole->run();
+
+		return true;
 	}
 
 	void CodeGenerator::generate_operator(ASTreeNS::ASTNode_t* node){
 		assert(node != nullptr);
 
+		size_t first = instructions.size();
+
 		switch (node->key.code){
 		case Operator::IF:
 			generate_branching(node);
@@ -29,6 +61,9 @@ namespace CodeGeneratorNS {
 		case Operator::DEC_FUNC:
 			generate_func_declaration(node);
 			break;
+		case Operator::CALL:
+			generate_expression(node);
+			break;
 		case Operator::WRITE:
 			generate_print(node);
 			break;
@@ -36,7 +71,7 @@ namespace CodeGeneratorNS {
 			generate_exit(node);
 			break;
 		case Operator::READ:
-		//	generate_input(node);
+			generate_input(node);
 			break;
 		case Operator::SQRT:
 		//	generate_sqrt(node);
@@ -46,167 +81,567 @@ namespace CodeGeneratorNS {
 			printf("Wrong operator %s\n", node->key.lexem);
 			break;
 		}
+
+		//nested statements are stamped first, the rest (conditions, prologues) belongs to this one
+		for (size_t i = first; i < instructions.size(); ++i){
+			if (instructions.lines[i] == 0) instructions.lines[i] = node->key.line;
+		}
 	}
 
 	void CodeGenerator::generate_block(ASTreeNS::ASTNode_t* node){
+		generate_block(node, symbols.block());
+	}
+
+	void CodeGenerator::generate_block(ASTreeNS::ASTNode_t* node, Assembly::Symbol label, uint32_t counter){
 		assert(node != nullptr);
 		assert(node->key.code == Operator::BLOCK);
 
-		size_t cur_bloc_num = num_blocks++;
-		instructions.push_back(new Assembly::Label(cur_bloc_num));
+		instructions.push_back(Assembly::Label(label));
+		generate_counter(counter);
 
 		while (node != nullptr && node->right() != nullptr){
 			generate_operator(node->right());
 
 			node = node->left();
 		}
-
-		//instructions.push_back(new Assembly::Comment(cur_bloc_num));
 	}
 
 	void CodeGenerator::generate_func_declaration(ASTreeNS::ASTNode_t* node){
 		assert(node != nullptr);
 		assert(node->key.code == Operator::DEC_FUNC);
 
-		cur_local_vars_num = 0;
-		cur_local_args_num = 0;
+		FuncInfo* func = call_graph->find(node->right()->key.lexem);
+		RegisterAllocator& allocator = *func->allocator;
+
+		locations = new HashTable<const char*, Location, hash, strcmp, 509>();
+
+		instructions.push_back(Assembly::Label(symbols.intern(node->right()->key.lexem)));
+		instructions.push_back(Assembly::PushReg(Assembly::Registers::RBP));
+		instructions.push_back(Assembly::MovReg2Reg(Assembly::Registers::RBP, Assembly::Registers::RSP));
 
-		local_offsets = new HashTable<const char*, int32_t, hash, strcmp, 509>();
+		assign_locations(allocator, func->conv);
 
-		instructions.push_back(new Assembly::Label(node->right()->key.lexem));
-		//instructions.push_back(new Assembly::Comment("{"));
-		instructions.push_back(new Assembly::PushReg(Assembly::Registers::RBP));
-		instructions.push_back(new Assembly::MovReg2Reg(Assembly::Registers::RBP, Assembly::Registers::RSP));
+		instructions.push_back(Assembly::SubReg2Val(Assembly::Registers::RSP, cur_frame_slots * 8));
 
-		count_local_offsets(node->right(), cur_local_vars_num);
-		count_function_arguments(node->left(), cur_local_args_num);
+		for (size_t i = 0; i < num_saved_regs; ++i){
+			instructions.push_back(Assembly::MovReg2Mem(Assembly::Registers::RBP, saved_offsets[i], saved_regs[i]));
+		}
 
-		instructions.push_back(new Assembly::SubReg2Val(Assembly::Registers::RSP, cur_local_vars_num * 8));
+		for (size_t i = 0; i < allocator.num_intervals(); ++i){
+			LiveInterval& arg = allocator[i];
+			if (!arg.is_arg || arg.uses == 1) continue;
 
-		generate_block(node->right()->right());
+			if (arg.arg_reg == Assembly::Registers::NOT_REG){
+				if (arg.loc.reg != Assembly::Registers::NOT_REG){
+					instructions.push_back(Assembly::MovMem2Reg(arg.loc.reg, Assembly::Registers::RBP, arg.loc.offset));
+				}
+			}
 
-		//instructions.push_back(new Assembly::Comment("}"));
+			else if (arg.loc.reg == arg.arg_reg){
+				continue;
+			}
+
+			else if (arg.loc.reg != Assembly::Registers::NOT_REG){
+				instructions.push_back(Assembly::MovReg2Reg(arg.loc.reg, arg.arg_reg));
+			}
+
+			else {
+				instructions.push_back(Assembly::MovReg2Mem(Assembly::Registers::RBP, arg.loc.offset, arg.arg_reg));
+			}
+		}
+
+		cur_entries = (profile != nullptr)?(profile->count(node->key.line, node->key.site, Counter::BODY)):(0);
+
+		generate_block(node->right()->right(), symbols.block(), counter_key(node->key, Counter::BODY));
+		generate_shared_epilogue();
+	}
+
+	void CodeGenerator::assign_locations(RegisterAllocator& allocator, const Convention& conv){
+		cur_frame_slots = allocator.num_spill_slots();
+		num_saved_regs  = 0;
+
+		for (size_t i = 0; i < Allocation::POOL_SIZE; ++i){
+			if (!conv.is_standard || !allocator.is_clobbered(i)) continue;
+
+			++cur_frame_slots;
+			saved_regs[num_saved_regs]    = Allocation::POOL[i];
+			saved_offsets[num_saved_regs] = cur_frame_slots * (-8);
+			++num_saved_regs;
+		}
+
+		cur_frame_slots += cur_frame_slots % 2; //keeps rsp 16-byte aligned at calls
+
+		for (size_t i = 0; i < allocator.num_intervals(); ++i){
+			locations->insert(allocator[i].var, allocator[i].loc);
+		}
+
+		cur_epilogue = symbols.block();
+	}
+
+	void CodeGenerator::load_var(Assembly::Registers::Reg dst, const char* var){
+		Location loc = locations->find(var)->val.second;
+
+		if (loc.reg != Assembly::Registers::NOT_REG){
+			instructions.push_back(Assembly::MovReg2Reg(dst, loc.reg));
+		}
+
+		else {
+			instructions.push_back(Assembly::MovMem2Reg(dst, Assembly::Registers::RBP, loc.offset));
+		}
+	}
+
+	void CodeGenerator::store_var(const char* var, Assembly::Registers::Reg src){
+		Location loc = locations->find(var)->val.second;
+
+		if (loc.reg != Assembly::Registers::NOT_REG){
+			instructions.push_back(Assembly::MovReg2Reg(loc.reg, src));
+		}
+
+		else {
+			instructions.push_back(Assembly::MovReg2Mem(Assembly::Registers::RBP, loc.offset, src));
+		}
+	}
+
+	void CodeGenerator::generate_epilogue(){
+		if (num_saved_regs != 0){
+			instructions.push_back(Assembly::Jmp(cur_epilogue));
+			return;
+		}
+
+		instructions.push_back(Assembly::MovReg2Reg(Assembly::Registers::RSP, Assembly::Registers::RBP));
+		instructions.push_back(Assembly::PopReg(Assembly::Registers::RBP));
+		instructions.push_back(Assembly::Ret());
+	}
+
+	void CodeGenerator::generate_shared_epilogue(){
+		if (num_saved_regs == 0) return;
+
+		instructions.push_back(Assembly::Label(cur_epilogue));
+
+		for (size_t i = 0; i < num_saved_regs; ++i){
+			instructions.push_back(Assembly::MovMem2Reg(saved_regs[i], Assembly::Registers::RBP, saved_offsets[i]));
+		}
+
+		instructions.push_back(Assembly::MovReg2Reg(Assembly::Registers::RSP, Assembly::Registers::RBP));
+		instructions.push_back(Assembly::PopReg(Assembly::Registers::RBP));
+		instructions.push_back(Assembly::Ret());
 	}
 
 	void CodeGenerator::generate_expression(ASTreeNS::ASTNode_t* node){
 		assert(node != nullptr);
-		
+
+		generate_subexpression(node, Allocation::SCRATCH, Allocation::SCRATCH_SIZE);
+	}
+
+	bool CodeGenerator::references(ASTreeNS::ASTNode_t* node, const char* var){
+		if (node == nullptr) return false;
+		if (node->key.type == TokenizerNS::ID && strcmp(node->key.lexem, var) == 0) return true;
+
+		return references(node->left(), var) || references(node->right(), var);
+	}
+
+	Assembly::Registers::Reg CodeGenerator::var_register(ASTreeNS::ASTNode_t* node){
+		assert(node != nullptr);
+
+		if (node->key.type != TokenizerNS::ID) return Assembly::Registers::NOT_REG;
+
+		return locations->find(node->key.lexem)->val.second.reg;
+	}
+
+	bool CodeGenerator::is_leaf(ASTreeNS::ASTNode_t* node){
+		return node->key.type == TokenizerNS::NUM || node->key.type == TokenizerNS::ID;
+	}
+
+	// Commutative operations keep a leaf on the right, where it can be an immediate or a memory operand.
+	bool CodeGenerator::swaps_operands(ASTreeNS::ASTNode_t* node){
+		return (node->key.code == Operator::ADD || node->key.code == Operator::MUL) &&
+		       is_leaf(node->left()) && !is_leaf(node->right());
+	}
+
+	Operand CodeGenerator::leaf_operand(ASTreeNS::ASTNode_t* node){
+		assert(node != nullptr);
+
+		Operand operand = {};
+
+		if (node->key.type == TokenizerNS::NUM){
+			operand.is_imm = true;
+			operand.val    = literal(node);
+			return operand;
+		}
+
+		Location loc = locations->find(node->key.lexem)->val.second;
+		operand.reg = loc.reg;
+
+		if (loc.reg == Assembly::Registers::NOT_REG){
+			operand.is_mem = true;
+			operand.val    = loc.offset;
+		}
+
+		return operand;
+	}
+
+	int64_t CodeGenerator::literal(ASTreeNS::ASTNode_t* node){
+		assert(node != nullptr && node->key.type == TokenizerNS::NUM);
+
+		return strtoll(node->key.lexem, nullptr, 10);
+	}
+
+	bool CodeGenerator::is_imm32_literal(ASTreeNS::ASTNode_t* node){
+		return node->key.type == TokenizerNS::NUM && Assembly::is_imm32(literal(node));
+	}
+
+	// Sethi-Ullman number: registers needed to evaluate node without spilling.
+	// A right leaf costs nothing, it is encoded as a register, imm32 or [rbp + disp] operand,
+	// idiv and literals that only fit a movabs are the exceptions that need a register.
+	size_t CodeGenerator::count_registers(ASTreeNS::ASTNode_t* node, bool is_right){
+		assert(node != nullptr);
+
+		if (is_leaf(node)){
+			if (!is_right) return 1;
+			if (node->key.type == TokenizerNS::NUM && !is_imm32_literal(node)) return 1;
+			if (node->parent()->key.code != Operator::DIV) return 0;
+
+			return (var_register(node) != Assembly::Registers::NOT_REG)?(0):(1);
+		}
+
+		if (node->key.code == Operator::CALL){
+			return 1;
+		}
+
+		ASTreeNS::ASTNode_t* lhs = node->left();
+		ASTreeNS::ASTNode_t* rhs = node->right();
+		if (swaps_operands(node)) std::swap(lhs, rhs);
+
+		size_t left  = count_registers(lhs, false);
+		size_t right = count_registers(rhs, true);
+
+		if (left == right) return left + 1;
+
+		return (left > right)?(left):(right);
+	}
+
+	void CodeGenerator::generate_subexpression(ASTreeNS::ASTNode_t* node, const Assembly::Registers::Reg* regs, size_t num_regs){
+		assert(node != nullptr);
+		assert(num_regs >= 1);
+
 		if (node->key.code == Operator::CALL){
-			size_t cur_num_args = 0;
+			generate_call(node);
+			instructions.push_back(Assembly::MovReg2Reg(regs[0], Assembly::Registers::RAX));
+			return;
+		}
 
-			push_arguments(node->left(), cur_num_args);
-			instructions.push_back(new Assembly::Call(node->right()->key.lexem));
-			instructions.push_back(new Assembly::AddVal2Reg(Assembly::Registers::RSP, (cur_num_args + 1) * 8));
+		if (node->key.type == TokenizerNS::NUM){
+			instructions.push_back(Assembly::MovVal2Reg(regs[0], literal(node)));
 			return;
 		}
 
-		if (node->right() != nullptr){
-			generate_expression(node->right());
+		if (node->key.type == TokenizerNS::ID){
+			load_var(regs[0], node->key.lexem);
+			return;
 		}
 
-		if (node->left() != nullptr){
-			instructions.push_back(new Assembly::MovReg2Reg(Assembly::Registers::R11, Assembly::Registers::R10));
-			generate_expression(node->left());
+		if (generate_address(node, regs[0])) return;
+
+		ASTreeNS::ASTNode_t* lhs = node->left();
+		ASTreeNS::ASTNode_t* rhs = node->right();
+		if (swaps_operands(node)) std::swap(lhs, rhs);
+
+		if (node->key.code == Operator::MUL && var_register(lhs) != Assembly::Registers::NOT_REG &&
+		    is_imm32_literal(rhs)){
+			instructions.push_back(Assembly::MulVal2Reg(regs[0], var_register(lhs), literal(rhs)));
+			return;
 		}
 
-		if (node->key.type == TokenizerNS::NUM){
-			instructions.push_back(new Assembly::MovVal2Reg(Assembly::Registers::R10,
-						                                    atoi(node->key.lexem)));
+		Operand src = generate_operands(lhs, rhs, regs, num_regs);
+		generate_arithmetic(node->key.code, regs[0], src);
+	}
+
+	// Sums of register Ideas and constants fit into a single lea, no copy of the left operand is needed.
+	bool CodeGenerator::generate_address(ASTreeNS::ASTNode_t* node, Assembly::Registers::Reg dst){
+		if (node->key.code != Operator::ADD && node->key.code != Operator::SUB) return false;
+
+		ASTreeNS::ASTNode_t* lhs = node->left();
+		ASTreeNS::ASTNode_t* rhs = node->right();
+
+		if (node->key.code == Operator::ADD && lhs->key.type == TokenizerNS::NUM) std::swap(lhs, rhs);
+
+		Assembly::Registers::Reg base = var_register(lhs);
+		if (base == Assembly::Registers::NOT_REG) return false;
+
+		if (node->key.code == Operator::ADD && var_register(rhs) != Assembly::Registers::NOT_REG){
+			instructions.push_back(Assembly::Lea(dst, base, var_register(rhs)));
+			return true;
 		}
 
-		if (node->key.type == TokenizerNS::ID && node->parent()->key.code != Operator::CALL){
+		if (!is_imm32_literal(rhs)) return false;
+
+		int64_t disp = literal(rhs);
+		if (node->key.code == Operator::SUB) disp = -disp;
+
+		if (!Assembly::is_imm32(disp)) return false;
+
+		instructions.push_back(Assembly::Lea(dst, base, disp));
+		return true;
+	}
+
+	Operand CodeGenerator::generate_operands(ASTreeNS::ASTNode_t* lhs, ASTreeNS::ASTNode_t* rhs, const Assembly::Registers::Reg* regs, size_t num_regs){
+		assert(lhs != nullptr && rhs != nullptr);
+
+		size_t left  = count_registers(lhs, false);
+		size_t right = count_registers(rhs, true);
+
+		Operand src = {};
+		src.reg = regs[1];
 
-		instructions.push_back(new Assembly::MovMem2Reg(Assembly::Registers::R10, Assembly::Registers::RBP,
-			                                            local_offsets->find(node->key.lexem)->val.second));
-			
+		if (right == 0){
+			generate_subexpression(lhs, regs, num_regs);
+			return leaf_operand(rhs);
 		}
 
-		if (node->key.type == TokenizerNS::OP && node->key.code != Operator::COMMA){
+		if (left >= num_regs && right >= num_regs){
+			assert(num_regs >= 2);
 
-			switch (node->key.code){
-				case Operator::ADD:
-					instructions.push_back(new Assembly::AddReg2Reg(Assembly::Registers::R10,
-					                                                Assembly::Registers::R11));
-					break;
+			generate_subexpression(rhs, regs, num_regs);
+			instructions.push_back(Assembly::PushReg(regs[0]));
+			generate_subexpression(lhs, regs, num_regs);
+			instructions.push_back(Assembly::PopReg(regs[1]));
 
-				case Operator::SUB:
-					instructions.push_back(new Assembly::SubReg2Reg(Assembly::Registers::R10,
-					                                                Assembly::Registers::R11));
+			return src;
+		}
 
-					break;
+		if (left >= right){
+			generate_subexpression(lhs, regs,     num_regs);
+			generate_subexpression(rhs, regs + 1, num_regs - 1);
 
-				case Operator::MUL:
+			return src;
+		}
 
-					instructions.push_back(new Assembly::MulReg2Reg(Assembly::Registers::R10,
-					                                                Assembly::Registers::R11));
-					break;
+		Assembly::Registers::Reg swapped[Allocation::SCRATCH_SIZE] = {};
+		memcpy(swapped, regs, num_regs * sizeof(regs[0]));
+		swapped[0] = regs[1];
+		swapped[1] = regs[0];
 
-				case Operator::DIV:
-					instructions.push_back(new Assembly::DivReg2Reg(Assembly::Registers::R10,
-					                                                Assembly::Registers::R11));
-					break;
+		generate_subexpression(rhs, swapped, num_regs);
+		generate_subexpression(lhs, swapped + 1, num_regs - 1);
 
-				default:
-					assert("Unknown operator code" && false);
-			}
+		return src;
+	}
+
+	void CodeGenerator::generate_arithmetic(Operator::code code, Assembly::Registers::Reg dst, Operand src){
+		switch (code){
+			case Operator::ADD:
+				if      (src.is_imm) instructions.push_back(Assembly::AddVal2Reg(dst, src.val));
+				else if (src.is_mem) instructions.push_back(Assembly::AddMem2Reg(dst, Assembly::Registers::RBP, src.val));
+				else                 instructions.push_back(Assembly::AddReg2Reg(dst, src.reg));
+				break;
+
+			case Operator::SUB:
+				if      (src.is_imm) instructions.push_back(Assembly::SubReg2Val(dst, src.val));
+				else if (src.is_mem) instructions.push_back(Assembly::SubMem2Reg(dst, Assembly::Registers::RBP, src.val));
+				else                 instructions.push_back(Assembly::SubReg2Reg(dst, src.reg));
+				break;
+
+			case Operator::MUL:
+				if      (src.is_imm) instructions.push_back(Assembly::MulVal2Reg(dst, dst, src.val));
+				else if (src.is_mem) instructions.push_back(Assembly::MulMem2Reg(dst, Assembly::Registers::RBP, src.val));
+				else                 instructions.push_back(Assembly::MulReg2Reg(dst, src.reg));
+				break;
+
+			case Operator::DIV:
+				assert(!src.is_imm && !src.is_mem);
+
+				instructions.push_back(Assembly::MovReg2Reg(Assembly::Registers::RAX, dst));
+				instructions.push_back(Assembly::Cqo());
+				instructions.push_back(Assembly::IdivReg(src.reg));
+				instructions.push_back(Assembly::MovReg2Reg(dst, Assembly::Registers::RAX));
+				break;
+
+			default:
+				assert("Unknown operator code" && false);
 		}
 	}
 
-	void CodeGenerator::push_arguments(ASTreeNS::ASTNode_t* node, size_t& num_args){
+	void CodeGenerator::generate_compare(Assembly::Registers::Reg dst, Operand src){
+		if      (src.is_imm) instructions.push_back(Assembly::CmpVal2Reg(dst, src.val));
+		else if (src.is_mem) instructions.push_back(Assembly::CmpMem2Reg(dst, Assembly::Registers::RBP, src.val));
+		else                 instructions.push_back(Assembly::CmpReg2Reg(dst, src.reg));
+	}
+
+	void CodeGenerator::generate_call(ASTreeNS::ASTNode_t* node){
 		assert(node != nullptr);
-		assert(node->key.code == Operator::COMMA);
-		
-		if (node->right() != nullptr){
-				++num_args;
+		assert(node->key.code == Operator::CALL);
 
-			if (node->left() != nullptr){
-				push_arguments(node->left(), num_args);
-			}
+		generate_counter(counter_key(node->key, Counter::CALL));
+
+		Vector<ASTreeNS::ASTNode_t*> args;
+
+		for (ASTreeNS::ASTNode_t* comma = node->left(); comma != nullptr && comma->right() != nullptr; comma = comma->left()){
+			args.push_back(comma->right());
+		}
 
-			generate_expression(node->right());
-			instructions.push_back(new Assembly::PushReg(Assembly::Registers::R10));
+		size_t num_reg_args   = (args.size() < Allocation::ARGUMENTS_SIZE)?(args.size()):(Allocation::ARGUMENTS_SIZE);
+		size_t num_stack_args = args.size() - num_reg_args;
+		size_t stack_size     = (num_stack_args + num_stack_args % 2) * 8;
+
+		if (num_stack_args % 2 != 0){
+			instructions.push_back(Assembly::SubReg2Val(Assembly::Registers::RSP, 8));
+		}
+
+		for (size_t i = args.size(); i > num_reg_args; --i){
+			generate_expression(args[i - 1]);
+			instructions.push_back(Assembly::PushReg(Allocation::SCRATCH[0]));
 		}
 
+		const Convention& conv = call_graph->convention(node->right()->key.lexem);
+
+		if (conv.is_standard) push_arguments(args, num_reg_args, conv);
+		else                  move_arguments(args, num_reg_args, conv);
+
+		instructions.push_back(Assembly::Call(symbols.intern(node->right()->key.lexem)));
+
+		if (stack_size != 0){
+			instructions.push_back(Assembly::AddVal2Reg(Assembly::Registers::RSP, stack_size));
+		}
 	}
 
-	void CodeGenerator::count_local_offsets(ASTreeNS::ASTNode_t* node, size_t& num_vars){
-		assert(node != nullptr);
+	// Compound arguments are evaluated first, all but the last one are parked on the stack
+	// since the scratch pool overlaps the argument registers. Ideas and numbers go last.
+	void CodeGenerator::push_arguments(Vector<ASTreeNS::ASTNode_t*>& args, size_t num_reg_args, const Convention& conv){
+		size_t last_compound = num_reg_args;
+
+		for (size_t i = 0; i < num_reg_args; ++i){
+			if (args[i]->key.type == TokenizerNS::OP) last_compound = i;
+		}
+
+		if (last_compound != num_reg_args && conv.args[last_compound] == Assembly::Registers::RDX){
+			last_compound = num_reg_args;
+		}
+
+		for (size_t i = 0; i < num_reg_args; ++i){
+			if (args[i]->key.type != TokenizerNS::OP || i == last_compound) continue;
+
+			generate_expression(args[i]);
+			instructions.push_back(Assembly::PushReg(Allocation::SCRATCH[0]));
+		}
+
+		if (last_compound != num_reg_args){
+			Assembly::Registers::Reg regs[Allocation::SCRATCH_SIZE] = {conv.args[last_compound]};
+			size_t num_regs = 1;
+
+			for (size_t i = 0; i < Allocation::SCRATCH_SIZE && num_regs < Allocation::SCRATCH_SIZE; ++i){
+				if (Allocation::SCRATCH[i] != regs[0]) regs[num_regs++] = Allocation::SCRATCH[i];
+			}
 
-		if (node->key.code == Operator::DEC_VAR){
-			++num_vars;
-			local_offsets->insert(node->right()->key.lexem, num_vars * (-8));
+			generate_subexpression(args[last_compound], regs, num_regs);
 		}
 
-		if (node->left() != nullptr){
-			count_local_offsets(node->left(), num_vars);
+		for (size_t i = num_reg_args; i > 0; --i){
+			if (args[i - 1]->key.type != TokenizerNS::OP || i - 1 == last_compound) continue;
+
+			instructions.push_back(Assembly::PopReg(conv.args[i - 1]));
 		}
 
-		if (node->right() != nullptr){
-			count_local_offsets(node->right(), num_vars);
+		for (size_t i = 0; i < num_reg_args; ++i){
+			if (args[i]->key.type == TokenizerNS::OP) continue;
+
+			generate_subexpression(args[i], conv.args + i, 1);
 		}
 	}
 
-	void CodeGenerator::generate_var_init(ASTreeNS::ASTNode_t* node){
-		assert(node != nullptr);
-		assert(node->key.code == Operator::ASSGN);
+	// Internal conventions pass arguments straight in the callee's registers, which may be
+	// the caller's Ideas as well: compound arguments are parked on the stack and the rest
+	// is a parallel move, cycles are broken through R11.
+	void CodeGenerator::move_arguments(Vector<ASTreeNS::ASTNode_t*>& args, size_t num_reg_args, const Convention& conv){
+		for (size_t i = 0; i < num_reg_args; ++i){
+			if (args[i]->key.type != TokenizerNS::OP || conv.args[i] == Assembly::Registers::NOT_REG) continue;
 
-		generate_expression(node->right());
+			generate_expression(args[i]);
+			instructions.push_back(Assembly::PushReg(Allocation::SCRATCH[0]));
+		}
+
+		Assembly::Registers::Reg srcs[Allocation::ARGUMENTS_SIZE] = {};
+		bool pending[Allocation::ARGUMENTS_SIZE] = {};
+		size_t num_pending = 0;
+
+		for (size_t i = 0; i < num_reg_args; ++i){
+			if (args[i]->key.type == TokenizerNS::OP || conv.args[i] == Assembly::Registers::NOT_REG) continue;
+
+			srcs[i] = var_register(args[i]);
+
+			if (srcs[i] != conv.args[i]){
+				pending[i] = true;
+				++num_pending;
+			}
+		}
+
+		while (num_pending != 0){
+			bool progress = false;
+
+			for (size_t i = 0; i < num_reg_args; ++i){
+				if (!pending[i]) continue;
+
+				bool is_read = false;
+
+				for (size_t j = 0; j < num_reg_args; ++j){
+					if (pending[j] && j != i && srcs[j] == conv.args[i]) is_read = true;
+				}
+
+				if (is_read) continue;
+
+				if (srcs[i] == Allocation::SCRATCH[1]){
+					instructions.push_back(Assembly::MovReg2Reg(conv.args[i], srcs[i]));
+				}
+
+				else {
+					generate_subexpression(args[i], conv.args + i, 1);
+				}
+
+				pending[i] = false;
+				progress   = true;
+				--num_pending;
+			}
+
+			if (progress) continue;
+
+			for (size_t i = 0; i < num_reg_args; ++i){
+				if (!pending[i]) continue;
 
-		instructions.push_back(new Assembly::MovReg2Mem(Assembly::Registers::RBP,
-		                       local_offsets->find(node->left()->key.lexem)->val.second, Assembly::Registers::R10));
+				instructions.push_back(Assembly::MovReg2Reg(Allocation::SCRATCH[1], conv.args[i]));
 
+				for (size_t j = 0; j < num_reg_args; ++j){
+					if (pending[j] && srcs[j] == conv.args[i]) srcs[j] = Allocation::SCRATCH[1];
+				}
+
+				break;
+			}
+		}
+
+		for (size_t i = num_reg_args; i > 0; --i){
+			if (args[i - 1]->key.type != TokenizerNS::OP || conv.args[i - 1] == Assembly::Registers::NOT_REG) continue;
+
+			instructions.push_back(Assembly::PopReg(conv.args[i - 1]));
+		}
 	}
 
-	void CodeGenerator::count_function_arguments(ASTreeNS::ASTNode_t* node, size_t& num_args){
+	void CodeGenerator::generate_var_init(ASTreeNS::ASTNode_t* node){
 		assert(node != nullptr);
-		assert(node->key.code == Operator::COMMA);
+		assert(node->key.code == Operator::ASSGN);
+
+		const char* var = node->left()->key.lexem;
+		Assembly::Registers::Reg var_reg = locations->find(var)->val.second.reg;
 
-		if (node->right() != nullptr){
-			++num_args;
-			local_offsets->insert(node->right()->key.lexem, (num_args + 1) * 8);
+		if (var_reg != Assembly::Registers::NOT_REG && !references(node->right(), var)){
+			Assembly::Registers::Reg regs[Allocation::SCRATCH_SIZE] = {};
+			memcpy(regs, Allocation::SCRATCH, sizeof(regs));
+			regs[0] = var_reg;
 
-			if (node->left() != nullptr) count_function_arguments(node->left(), num_args);
+			generate_subexpression(node->right(), regs, Allocation::SCRATCH_SIZE);
+			return;
 		}
+
+		generate_expression(node->right());
+
+		store_var(var, Assembly::Registers::R10);
 	}
 
 	void CodeGenerator::generate_return(ASTreeNS::ASTNode_t* node){
@@ -215,62 +650,134 @@ namespace CodeGeneratorNS {
 
 		generate_expression(node->right());
 
-		instructions.push_back(new Assembly::MovReg2Reg(Assembly::Registers::RAX, Assembly::Registers::R10));
-		instructions.push_back(new Assembly::MovReg2Reg(Assembly::Registers::RSP, Assembly::Registers::RBP));
-		instructions.push_back(new Assembly::PopReg(Assembly::Registers::RBP));
-		instructions.push_back(new Assembly::Ret());
+		instructions.push_back(Assembly::MovReg2Reg(Assembly::Registers::RAX, Assembly::Registers::R10));
+		generate_epilogue();
+	}
+
+	Operator::code CodeGenerator::swap_comparison(Operator::code code){
+		switch (code){
+			case Operator::LESS:   return Operator::MORE;
+			case Operator::MORE:   return Operator::LESS;
+			case Operator::EQLESS: return Operator::EQMORE;
+			case Operator::EQMORE: return Operator::EQLESS;
+			default:               return code;
+		}
 	}
 
 	void CodeGenerator::generate_branching(ASTreeNS::ASTNode_t* node){
 		assert(node != nullptr);
 		assert(node->key.code == Operator::IF);
 
-		generate_expression(node->left()->left());
-		instructions.push_back(new Assembly::MovReg2Reg(Assembly::Registers::R11, Assembly::Registers::R10));
+		ASTreeNS::ASTNode_t* lhs = node->left()->left();
+		ASTreeNS::ASTNode_t* rhs = node->left()->right();
+		Operator::code code = node->left()->key.code;
+
+		if (lhs->key.type == TokenizerNS::NUM && rhs->key.type != TokenizerNS::NUM){
+			std::swap(lhs, rhs);
+			code = swap_comparison(code);
+		}
+
+		if (var_register(lhs) != Assembly::Registers::NOT_REG && count_registers(rhs, true) == 0){
+			generate_compare(var_register(lhs), leaf_operand(rhs));
+		}
 
-		generate_expression(node->left()->right());
+		else {
+			generate_compare(Allocation::SCRATCH[0], generate_operands(lhs, rhs, Allocation::SCRATCH, Allocation::SCRATCH_SIZE));
+		}
 
-		instructions.push_back(new Assembly::CmpReg2Reg(Assembly::Registers::R11, Assembly::Registers::R10));
+		Assembly::Symbol then_label = symbols.block();
+		Assembly::Symbol else_label = symbols.block();
+		Assembly::Symbol end_label  = symbols.block();
 
-		switch (node->left()->key.code){
+		switch (code){
 			case Operator::EQL:
-				instructions.push_back(new Assembly::Jz(num_blocks));
-				instructions.push_back(new Assembly::Jmp(num_blocks + 1));
+				instructions.push_back(Assembly::Jz(then_label));
+				instructions.push_back(Assembly::Jmp(else_label));
 				break;
 
 			case Operator::NEQL:
-				instructions.push_back(new Assembly::Jnz(num_blocks));
-				instructions.push_back(new Assembly::Jmp(num_blocks + 1));
+				instructions.push_back(Assembly::Jnz(then_label));
+				instructions.push_back(Assembly::Jmp(else_label));
 				break;
 
 			case Operator::EQLESS:
-				instructions.push_back(new Assembly::Jle(num_blocks));
-				instructions.push_back(new Assembly::Jmp(num_blocks + 1));
+				instructions.push_back(Assembly::Jle(then_label));
+				instructions.push_back(Assembly::Jmp(else_label));
 				break;
 
 			case Operator::EQMORE:
-				instructions.push_back(new Assembly::Jge(num_blocks));
-				instructions.push_back(new Assembly::Jmp(num_blocks + 1));
+				instructions.push_back(Assembly::Jge(then_label));
+				instructions.push_back(Assembly::Jmp(else_label));
 				break;
 
 			case Operator::LESS:
-				instructions.push_back(new Assembly::Jl(num_blocks));
-				instructions.push_back(new Assembly::Jmp(num_blocks + 1));
+				instructions.push_back(Assembly::Jl(then_label));
+				instructions.push_back(Assembly::Jmp(else_label));
 				break;
 
 			case Operator::MORE:
-				instructions.push_back(new Assembly::Jg(num_blocks));
-				instructions.push_back(new Assembly::Jmp(num_blocks + 1));
+				instructions.push_back(Assembly::Jg(then_label));
+				instructions.push_back(Assembly::Jmp(else_label));
 				break;
 
 			default:
 				assert("Wrong branching format" && false);
 		}
 
-		generate_block(node->right()->right());
-		instructions.push_back(new Assembly::Jmp(num_blocks + 1));
-		generate_block(node->right()->left ());
-		instructions.push_back(new Assembly::Label(num_blocks++));
+		//the arm that ran more often in the profile falls through from the comparison
+		const TokenizerNS::Token& branch = node->key;
+
+		if (profile != nullptr && profile->count(branch.line, branch.site, Counter::ELSE) > profile->count(branch.line, branch.site, Counter::THEN)){
+			generate_arm(node->right()->left (), else_label, branch, Counter::ELSE);
+			instructions.push_back(Assembly::Jmp(end_label));
+			generate_arm(node->right()->right(), then_label, branch, Counter::THEN);
+
+			++num_swapped_arms;
+		}
+
+		else {
+			generate_arm(node->right()->right(), then_label, branch, Counter::THEN);
+			instructions.push_back(Assembly::Jmp(end_label));
+			generate_arm(node->right()->left (), else_label, branch, Counter::ELSE);
+		}
+
+		instructions.push_back(Assembly::Label(end_label));
+	}
+
+	// Blocks of an arm that is cold in the profile, nested ones included, are moved out of line.
+	void CodeGenerator::generate_arm(ASTreeNS::ASTNode_t* node, Assembly::Symbol label, const TokenizerNS::Token& branch, Counter::Kind kind){
+		size_t first_label = symbols.size();
+
+		generate_block(node, label, counter_key(branch, kind));
+
+		if (profile == nullptr || !profile->is_cold(branch.line, branch.site, kind, cur_entries)) return;
+
+		cfg->mark_cold(label);
+
+		for (size_t i = first_label; i < symbols.size(); ++i){
+			if (!symbols.is_named(i)) cfg->mark_cold({(int32_t)i});
+		}
+	}
+
+	void CodeGenerator::runtime_calls(Vector<const char*>& names){
+		names.push_back(Linkage::WRITE_NUM);
+		names.push_back(Linkage::READ_NUM);
+
+		if (is_instrumented) names.push_back(Linkage::COUNT);
+	}
+
+	//the runtime preserves every register and pops the key itself, flags are dead where counters go
+	void CodeGenerator::generate_counter(uint32_t counter){
+		if (counter == NO_COUNTER) return;
+
+		instructions.push_back(Assembly::PushVal(counter));
+		instructions.push_back(Assembly::Call(symbols.intern(Linkage::COUNT)));
+	}
+
+	uint32_t CodeGenerator::counter_key(const TokenizerNS::Token& key, Counter::Kind kind){
+		if (!is_instrumented || key.line == 0 || key.line >= Counter::MAX_LINES || key.site >= Counter::MAX_SITES) return NO_COUNTER;
+
+		return Counter::key(key.line, key.site, kind);
 	}
 
 	void CodeGenerator::generate_exit(ASTreeNS::ASTNode_t* node){
@@ -278,71 +785,655 @@ namespace CodeGeneratorNS {
 		assert(node->key.code == Operator::EXIT);
 
 		/*
-		instructions.push_back(new Assembly::MovVal2Reg(Assembly::Registers::RAX, 60));
-		instructions.push_back(new Assembly::MovVal2Reg(Assembly::Registers::RDI, 0));
-		instructions.push_back(new Assembly::Syscall());
+		instructions.push_back(Assembly::MovVal2Reg(Assembly::Registers::RAX, 60));
+		instructions.push_back(Assembly::MovVal2Reg(Assembly::Registers::RDI, 0));
+		instructions.push_back(Assembly::Syscall());
 		*/
 
-		instructions.push_back(new Assembly::MovReg2Reg(Assembly::Registers::RAX, Assembly::Registers::R10));
-		instructions.push_back(new Assembly::MovReg2Reg(Assembly::Registers::RSP, Assembly::Registers::RBP));
-		instructions.push_back(new Assembly::PopReg(Assembly::Registers::RBP));
-		instructions.push_back(new Assembly::Ret());
+		instructions.push_back(Assembly::MovReg2Reg(Assembly::Registers::RAX, Assembly::Registers::R10));
+		generate_epilogue();
 	}
 
 	void CodeGenerator::generate_print(ASTreeNS::ASTNode_t* node){
 		assert(node != nullptr);
 		assert(node->key.code == Operator::WRITE);
 
-		instructions.push_back(new Assembly::MovMem2Reg(Assembly::Registers::RAX, "num_format"));
-		generate_expression(node->right());
-		instructions.push_back(new Assembly::PushReg(Assembly::Registers::R10));
-		instructions.push_back(new Assembly::Call("_vprintf"));
+		Assembly::Registers::Reg regs[Allocation::SCRATCH_SIZE] = {Allocation::ARGUMENTS[0]};
+		size_t num_regs = 1;
+
+		for (size_t i = 0; i < Allocation::SCRATCH_SIZE; ++i){
+			if (Allocation::SCRATCH[i] != regs[0]) regs[num_regs++] = Allocation::SCRATCH[i];
+		}
+
+		//the runtime preserves every register, the value is passed as the first argument
+		generate_subexpression(node->right(), regs, num_regs);
+		instructions.push_back(Assembly::Call(symbols.intern(Linkage::WRITE_NUM)));
 	}
 
-	size_t CodeGenerator::write_elf(uint8_t* buf){
-		assert(buf != nullptr);
+	void CodeGenerator::generate_input(ASTreeNS::ASTNode_t* node){
+		assert(node != nullptr);
+		assert(node->key.code == Operator::READ);
 
+		//the runtime preserves every register but RAX
+		instructions.push_back(Assembly::Call(symbols.intern(Linkage::READ_NUM)));
+		store_var(node->right()->key.lexem, Assembly::Registers::RAX);
+	}
+
+	void CodeGenerator::place_labels(Vector<uint8_t>& is_short){
 		int32_t cur_instruction_offset = 0;
 
-		HashTable<const char*, int32_t, hash, strcmp, 509> label_offsets;
+		for (size_t i = 0; i < instructions.size(); ++i){
+			if (instructions[i].op == Assembly::Opcodes::LABEL) label_offsets[instructions[i].label] = cur_instruction_offset;
 
+			cur_instruction_offset += Assembly::size(instructions[i], is_short[i]);
+		}
+	}
 
+	// Every jump that has a rel8 form starts short, the ones whose target turns out
+	// to be too far are widened and the labels are placed again. Jumps only grow,
+	// so this stops after at most as many rounds as there are jumps.
+	void CodeGenerator::relax_jumps(Vector<uint8_t>& is_short){
 		for (size_t i = 0; i < instructions.size(); ++i){
-			cur_instruction_offset += instructions[i]->size();
+			is_short[i] = Assembly::has_short_form(instructions[i]);
+		}
+
+		bool is_changed = true;
+
+		while (is_changed){
+			is_changed = false;
+			place_labels(is_short);
+
+			int32_t cur_instruction_offset = 0;
+
+			for (size_t i = 0; i < instructions.size(); ++i){
+				cur_instruction_offset += Assembly::size(instructions[i], is_short[i]);
+
+				if (!is_short[i]) continue;
+
+				int32_t target = label_offsets[instructions[i].label];
 
-			if (instructions[i]->spec_type() == Assembly::LABEL){
-				label_offsets.insert(instructions[i]->string(), cur_instruction_offset);
+				if (target == -1 || !Assembly::is_imm8(target - cur_instruction_offset)){
+					is_short[i] = false;
+					is_changed = true;
+				}
 			}
 		}
+	}
+
+	size_t CodeGenerator::write_elf(CodeBuffer& buf){
+		Vector<uint8_t> is_short;
+		Vector<Assembly::Fixup> fixups;
+
+		label_offsets.resize(symbols.size());
+		is_short.resize(instructions.size());
 
-		cur_instruction_offset  = 0;
-		int32_t cur_label_offset = 0;
+		for (size_t i = 0; i < label_offsets.size(); ++i) label_offsets[i] = -1;
+
+		relax_jumps(is_short);
+
+		size_t start = buf.size();
+		num_short_jumps = 0;
+		relocations.resize(0);
+		line_rows.resize(0);
 
 		for (size_t i = 0; i < instructions.size(); ++i){
+			const Assembly::Instruction& ins = instructions[i];
+
+			//labels take no bytes, the row goes to the instruction after them
+			uint32_t line = instructions.lines[i];
+
+			if (line != 0){
+				uint32_t offset = buf.size() - start;
+				size_t last = line_rows.size() - 1;
+
+				if      (line_rows.size() != 0 && line_rows[last].offset == offset) line_rows[last].line = line;
+				else if (line_rows.size() == 0 || line_rows[last].line != line) line_rows.push_back({offset, line});
+			}
+
+			Assembly::encode(buf, ins, 0, is_short[i]);
+
+			if (Assembly::spec_type(ins) == Assembly::JUMP){
+				uint8_t size = (is_short[i])?(1):(4);
+				fixups.push_back({buf.size() - size, size, ins.label, ins.op});
+			}
 
-			if (instructions[i]->spec_type() == Assembly::JUMP){
-				cur_label_offset = label_offsets.find(instructions[i]->string())->val.second;
-				instructions[i]->set_offset(cur_label_offset - cur_instruction_offset - instructions[i]->size());
+			if (ins.op == Assembly::Opcodes::LOAD_LABEL){
+				relocations.push_back({buf.size() - start - 4, 4, ins.label, ins.op});
 			}
 
-			cur_instruction_offset += instructions[i]->size();
+			num_short_jumps += is_short[i];
 		}
-		
-		uint8_t* start = buf;
 
-		for (size_t i = 0; i < instructions.size(); ++i){
-			memcpy(buf, instructions[i]->elf(), instructions[i]->size());
-			buf += instructions[i]->size();
+		//targets outside the code (runtime entry points) are left for the linker
+		for (size_t i = 0; i < fixups.size(); ++i){
+			int32_t target = label_offsets[fixups[i].label];
+
+			if (target == -1){
+				relocations.push_back({fixups[i].pos - start, fixups[i].size, fixups[i].label, fixups[i].op});
+				continue;
+			}
+
+			int32_t rel = target - (int32_t)(fixups[i].pos - start + fixups[i].size);
+
+			if (fixups[i].size == 1) buf.data()[fixups[i].pos] = (uint8_t)rel;
+			else                     memcpy(buf.data() + fixups[i].pos, &rel, 4);
 		}
 
-		return buf - start;
+		return buf.size() - start;
 	};
 
+	//up to the next Theurgy or the end of the code
+	size_t CodeGenerator::function_size(size_t label, size_t code_size){
+		assert(label_offsets[label] != -1);
+
+		size_t end = code_size;
+
+		for (size_t i = 0; i < symbols.size(); ++i){
+			if (!symbols.is_named(i) || label_offsets[i] <= label_offsets[label]) continue;
+			if ((size_t)label_offsets[i] < end) end = label_offsets[i];
+		}
+
+		return end - label_offsets[label];
+	}
+
+	// Static executable without an assembler or linker: the headers, the code and an entry
+	// stub make up an R+X segment that maps the file as is. Code that calls into the runtime
+	// gets runtime.o linked in by the compiler: its read-only sections join the R+X segment,
+	// the writable ones and .bss make a second, R+W segment. The stub calls _start like any
+	// other Theurgy, runs the runtime's exit hooks and hands the result to exit.
+	bool CodeGenerator::write_exe(const char* filename, const char* runtime_name){
+		assert(filename     != nullptr);
+		assert(runtime_name != nullptr);
+
+		using namespace ELF::IntelExec86_64;
+
+		const size_t headers_size = sizeof(ELF::Header) + 2 * sizeof(ELF::ProgramHeader);
+
+		Assembly::Symbol start = symbols.intern("_start");
+		Assembly::Instruction call = Assembly::Call(start);
+
+		CodeBuffer code;
+		code.append(headers_size);
+
+		write_elf(code);
+
+		if (label_offsets[start.id] == -1){
+			fprintf(stderr, "undefined symbol _start\n");
+			return false;
+		}
+
+		ObjectFile runtime;
+		bool is_linked = relocations.size() != 0;
+
+		if (is_linked){
+			if (!runtime.load(runtime_name)) return false;
+
+			runtime.place(code, false);
+		}
+
+		//call targets of the stub, _start first
+		uint64_t targets[1 + Linking::NUM_EXIT_HOOKS] = {LOAD_ADDR + headers_size + label_offsets[start.id]};
+		size_t num_targets = 1;
+
+		for (size_t i = 0; is_linked && i < Linking::NUM_EXIT_HOOKS; ++i, ++num_targets){
+			if (!runtime.find(Linking::EXIT_HOOKS[i], LOAD_ADDR, targets[num_targets])){
+				fprintf(stderr, "undefined symbol %s in %s\n", Linking::EXIT_HOOKS[i], runtime_name);
+				return false;
+			}
+		}
+
+		size_t entry = code.size();
+
+		for (size_t i = 0; i < num_targets; ++i){
+			Assembly::encode(code, call, targets[i] - (LOAD_ADDR + code.size() + Assembly::size(call)));
+
+			//the result waits in rbx, which the hooks preserve
+			if (i == 0 && is_linked) Assembly::encode(code, Assembly::MovReg2Reg(Assembly::Registers::RBX, Assembly::Registers::RAX));
+		}
+
+		Assembly::Registers::Reg result = (is_linked)?(Assembly::Registers::RBX):(Assembly::Registers::RAX);
+
+		Assembly::encode(code, Assembly::MovReg2Reg(Assembly::Registers::RDI, result));
+		Assembly::encode(code, Assembly::MovVal2Reg(Assembly::Registers::RAX, 60));
+		Assembly::encode(code, Assembly::Syscall());
+
+		size_t text_size = code.size();
+		size_t data_offset = 0;
+		size_t data_end    = 0;
+
+		if (is_linked){
+			align(code, PAGE_SIZE);
+			data_offset = code.size();
+
+			runtime.place(code, true);
+			data_end = runtime.place_nobits(code.size());
+
+			if (!runtime.relocate(code, LOAD_ADDR)) return false;
+		}
+
+		//calls from the code into the runtime
+		for (size_t i = 0; i < relocations.size(); ++i){
+			const Assembly::Fixup& fixup = relocations[i];
+			uint64_t address = 0;
+
+			if (!runtime.find(symbols.name(fixup.label), LOAD_ADDR, address)){
+				fprintf(stderr, "undefined symbol %s in %s\n", symbols.name(fixup.label), runtime_name);
+				return false;
+			}
+
+			uint64_t place = LOAD_ADDR + headers_size + fixup.pos;
+			int32_t value = (fixup.op == Assembly::Opcodes::LOAD_LABEL)?((int32_t)address):((int32_t)(address - (place + 4)));
+
+			memcpy(code.data() + headers_size + fixup.pos, &value, 4);
+		}
+
+		ELF::Header header = {};
+		header.EI_MAG      = ELF::MAG_NUM;
+		header.EI_CLASS    = CLASS;
+		header.EI_DATA     = DATA2LSB;
+		header.EI_VERSION  = EV_CURENT;
+		header.EI_OSABI    = SYSV_ABI;
+		header.E_TYPE      = ET_EXEC;
+		header.E_MACHINE   = EM;
+		header.E_VERSION   = EV_CURENT;
+		header.E_ENTRY     = LOAD_ADDR + entry;
+		header.E_PHOFF     = sizeof(ELF::Header);
+		header.E_EHSIZE    = EHSIZE;
+		header.E_PHENTSIZE = PHENTSIZE;
+		header.E_PHNUM     = (is_linked)?(2):(1);
+		header.E_SHENTSIZE = SHENTSIZE;
+
+		ELF::ProgramHeader segments[2] = {};
+		segments[0].P_TYPE   = ELF::SegType::PT_LOAD;
+		segments[0].P_FLAGS  = ELF::ProgFlags::PF_R | ELF::ProgFlags::PF_X;
+		segments[0].P_VADDR  = LOAD_ADDR;
+		segments[0].P_PADDR  = LOAD_ADDR;
+		segments[0].P_FILESZ = text_size;
+		segments[0].P_MEMSZ  = text_size;
+		segments[0].P_ALLIGN = PAGE_SIZE;
+
+		if (is_linked){
+			segments[1].P_TYPE   = ELF::SegType::PT_LOAD;
+			segments[1].P_FLAGS  = ELF::ProgFlags::PF_R | ELF::ProgFlags::PF_W;
+			segments[1].P_OFFSET = data_offset;
+			segments[1].P_VADDR  = LOAD_ADDR + data_offset;
+			segments[1].P_PADDR  = LOAD_ADDR + data_offset;
+			segments[1].P_FILESZ = code.size() - data_offset;
+			segments[1].P_MEMSZ  = data_end - data_offset;
+			segments[1].P_ALLIGN = PAGE_SIZE;
+		}
+
+		memcpy(code.data(), &header, sizeof(header));
+		memcpy(code.data() + sizeof(header), segments, sizeof(segments));
+
+		FILE* output_f = fopen(filename, "wb");
+		if (output_f == nullptr) return false;
+
+		fwrite(code.data(), 1, code.size(), output_f);
+		fclose(output_f);
+
+		return chmod(filename, 0755) == 0;
+	}
+
+	size_t CodeGenerator::add_string(CodeBuffer& table, const char* str){
+		size_t offset = table.size();
+		size_t len    = strlen(str) + 1;
+
+		memcpy(table.append(len), str, len);
+		return offset;
+	}
+
+	void CodeGenerator::add_uleb(CodeBuffer& buf, uint64_t value){
+		do {
+			uint8_t byte = value & 0x7F;
+			value >>= 7;
+
+			*buf.append(1) = (value != 0)?(byte | 0x80):(byte);
+		} while (value != 0);
+	}
+
+	void CodeGenerator::add_sleb(CodeBuffer& buf, int64_t value){
+		for (;;){
+			uint8_t byte = value & 0x7F;
+			value >>= 7;
+
+			bool is_last = (value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40));
+			*buf.append(1) = (is_last)?(byte):(byte | 0x80);
+
+			if (is_last) break;
+		}
+	}
+
+	void CodeGenerator::align(CodeBuffer& buf, size_t alignment){
+		size_t padding = (alignment - buf.size() % alignment) % alignment;
+
+		memset(buf.append(padding), 0, padding);
+	}
+
+	// Relocatable object for the system linker: .text, one symbol per Theurgy and a
+	// relocation for every reference to a symbol outside the code. Theurgies with an
+	// internal convention cannot be called from C, so they stay local, and so does
+	// _start, which would clash with the C runtime's entry point. A DWARF compilation
+	// unit with a line table maps the code back to the lines of source. An empty .note.GNU-stack
+	// without SHF_EXECINSTR tells ld that the code does not need an executable stack.
+	bool CodeGenerator::write_obj(const char* filename, const char* source){
+		assert(filename != nullptr);
+		assert(source   != nullptr);
+
+		enum {NULL_SECTION, TEXT, SYMTAB, STRTAB, RELA_TEXT, DEBUG_ABBREV, DEBUG_INFO, RELA_DEBUG_INFO,
+		      DEBUG_LINE, RELA_DEBUG_LINE, NOTE_GNU_STACK, SHSTRTAB, NUM_SECTIONS};
+
+		CodeBuffer file;
+		file.append(sizeof(ELF::Header));
+
+		size_t text_offset = file.size();
+		size_t text_size   = write_elf(file);
+
+		CodeBuffer strtab;
+		add_string(strtab, "");
+
+		Vector<uint32_t> sym_index;
+		sym_index.resize(symbols.size());
+
+		for (size_t i = 0; i < sym_index.size(); ++i) sym_index[i] = 0;
+
+		Vector<ELF::Symbol> symtab;
+		symtab.push_back({});
+
+		//debug sections refer to the sections they describe through these
+		const uint32_t section_syms[] = {TEXT, DEBUG_ABBREV, DEBUG_LINE};
+		uint32_t section_sym[NUM_SECTIONS] = {};
+
+		for (size_t i = 0; i < sizeof(section_syms) / sizeof(section_syms[0]); ++i){
+			section_sym[section_syms[i]] = symtab.size();
+			symtab.push_back({0, (uint8_t)(ELF::SymBind::STB_LOCAL << 4 | ELF::SymType::STT_SECTION),
+			                  0, (uint16_t)section_syms[i], 0, 0});
+		}
+
+		size_t first_global = 0;
+
+		//locals first, the way the symbol table is required to be ordered
+		for (int is_global = 0; is_global <= 1; ++is_global){
+			if (is_global) first_global = symtab.size();
+
+			for (size_t i = 0; i < symbols.size(); ++i){
+				if (!symbols.is_named(i) || label_offsets[i] == -1) continue;
+				bool is_exported = call_graph->convention(symbols.name(i)).is_standard && strcmp(symbols.name(i), "_start") != 0;
+				if (is_exported != (bool)is_global) continue;
+
+				uint8_t bind = (is_global)?(ELF::SymBind::STB_GLOBAL):(ELF::SymBind::STB_LOCAL);
+
+				sym_index[i] = symtab.size();
+				symtab.push_back({(uint32_t)add_string(strtab, symbols.name(i)), (uint8_t)(bind << 4 | ELF::SymType::STT_FUNC),
+				                  0, TEXT, (uint64_t)label_offsets[i], function_size(i, text_size)});
+			}
+		}
+
+		Vector<ELF::Rela> rela;
+
+		for (size_t i = 0; i < relocations.size(); ++i){
+			const Assembly::Fixup& fixup = relocations[i];
+
+			if (sym_index[fixup.label] == 0){
+				sym_index[fixup.label] = symtab.size();
+				symtab.push_back({(uint32_t)add_string(strtab, symbols.name(fixup.label)),
+				                  (uint8_t)(ELF::SymBind::STB_GLOBAL << 4 | ELF::SymType::STT_NOTYPE), 0, ELF::SHN_UNDEF, 0, 0});
+			}
+
+			uint32_t type   = ELF::RelType::R_X86_64_PC32;
+			int64_t  addend = -4; //rel32 is taken from the end of the field
+
+			if (fixup.op == Assembly::Opcodes::CALL){
+				type = ELF::RelType::R_X86_64_PLT32;
+			}
+
+			else if (fixup.op == Assembly::Opcodes::LOAD_LABEL){
+				type   = ELF::RelType::R_X86_64_32S;
+				addend = 0;
+			}
+
+			rela.push_back({fixup.pos, (uint64_t)sym_index[fixup.label] << 32 | type, addend});
+		}
+
+		using namespace ELF::DWARF;
+
+		//one abbreviation, for the compilation unit, its attributes in the order .debug_info stores them
+		CodeBuffer abbrev;
+		const uint8_t cu_attributes[] = {DW_AT_stmt_list, DW_FORM_sec_offset, DW_AT_low_pc,   DW_FORM_addr,
+		                                 DW_AT_high_pc,   DW_FORM_data8,      DW_AT_name,     DW_FORM_string,
+		                                 DW_AT_comp_dir,  DW_FORM_string,     DW_AT_producer, DW_FORM_string, 0, 0};
+		add_uleb(abbrev, 1);
+		add_uleb(abbrev, DW_TAG_compile_unit);
+		*abbrev.append(1) = DW_CHILDREN_no;
+		memcpy(abbrev.append(sizeof(cu_attributes)), cu_attributes, sizeof(cu_attributes));
+		*abbrev.append(1) = 0;
+
+		char comp_dir[4096] = "";
+		if (getcwd(comp_dir, sizeof(comp_dir)) == nullptr) comp_dir[0] = '\0';
+
+		//unit_length, version, abbrev offset, address size, then the unit itself
+		CodeBuffer info;
+		info.append(4);
+		memcpy(info.append(2), &VERSION, 2);
+		memset(info.append(4), 0, 4);
+		*info.append(1) = 8;
+		add_uleb(info, 1);
+		memset(info.append(4 + 8), 0, 4 + 8); //stmt_list and low_pc are relocated
+		uint64_t high_pc = text_size;
+		memcpy(info.append(8), &high_pc, 8);
+		add_string(info, source);
+		add_string(info, comp_dir);
+		add_string(info, "Aristotle");
+
+		uint32_t info_length = info.size() - 4;
+		memcpy(info.data(), &info_length, 4);
+
+		Vector<ELF::Rela> rela_info;
+		rela_info.push_back({6,  (uint64_t)section_sym[DEBUG_ABBREV] << 32 | ELF::RelType::R_X86_64_32, 0});
+		rela_info.push_back({12, (uint64_t)section_sym[DEBUG_LINE]   << 32 | ELF::RelType::R_X86_64_32, 0});
+		rela_info.push_back({16, (uint64_t)section_sym[TEXT]         << 32 | ELF::RelType::R_X86_64_64, 0});
+
+		//header: unit_length, version, header_length, then the fields header_length covers
+		const uint8_t std_opcode_lengths[OPCODE_BASE - 1] = {0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1};
+
+		CodeBuffer line;
+		line.append(4);
+		memcpy(line.append(2), &VERSION, 2);
+		line.append(4);
+
+		size_t header_start = line.size();
+		const uint8_t line_params[] = {1, 1, 1, (uint8_t)LINE_BASE, LINE_RANGE, OPCODE_BASE}; //min length, max ops, is_stmt
+		memcpy(line.append(sizeof(line_params)), line_params, sizeof(line_params));
+		memcpy(line.append(sizeof(std_opcode_lengths)), std_opcode_lengths, sizeof(std_opcode_lengths));
+		*line.append(1) = 0; //no include directories
+		add_string(line, source);
+		add_uleb(line, 0); //directory, modification time, length
+		add_uleb(line, 0);
+		add_uleb(line, 0);
+		*line.append(1) = 0;
+
+		uint32_t header_length = line.size() - header_start;
+		memcpy(line.data() + 6, &header_length, 4);
+
+		*line.append(1) = 0;
+		add_uleb(line, 9);
+		*line.append(1) = DW_LNE_set_address;
+
+		Vector<ELF::Rela> rela_line;
+		rela_line.push_back({line.size(), (uint64_t)section_sym[TEXT] << 32 | ELF::RelType::R_X86_64_64, 0});
+		memset(line.append(8), 0, 8);
+
+		uint32_t cur_offset = 0;
+		uint32_t cur_line   = 1;
+
+		for (size_t i = 0; i < line_rows.size(); ++i){
+			if (line_rows[i].offset != cur_offset){
+				*line.append(1) = DW_LNS_advance_pc;
+				add_uleb(line, line_rows[i].offset - cur_offset);
+			}
+
+			if (line_rows[i].line != cur_line){
+				*line.append(1) = DW_LNS_advance_line;
+				add_sleb(line, (int64_t)line_rows[i].line - cur_line);
+			}
+
+			*line.append(1) = DW_LNS_copy;
+
+			cur_offset = line_rows[i].offset;
+			cur_line   = line_rows[i].line;
+		}
+
+		if (text_size != cur_offset){
+			*line.append(1) = DW_LNS_advance_pc;
+			add_uleb(line, text_size - cur_offset);
+		}
+
+		*line.append(1) = 0;
+		add_uleb(line, 1);
+		*line.append(1) = DW_LNE_end_sequence;
+
+		uint32_t line_length = line.size() - 4;
+		memcpy(line.data(), &line_length, 4);
+
+		align(file, 8);
+		size_t symtab_offset = file.size();
+		memcpy(file.append(symtab.size() * sizeof(ELF::Symbol)), &symtab[0], symtab.size() * sizeof(ELF::Symbol));
+
+		size_t strtab_offset = file.size();
+		memcpy(file.append(strtab.size()), strtab.data(), strtab.size());
+
+		align(file, 8);
+		size_t rela_offset = file.size();
+		if (rela.size() != 0) memcpy(file.append(rela.size() * sizeof(ELF::Rela)), &rela[0], rela.size() * sizeof(ELF::Rela));
+
+		size_t abbrev_offset = file.size();
+		memcpy(file.append(abbrev.size()), abbrev.data(), abbrev.size());
+
+		size_t info_offset = file.size();
+		memcpy(file.append(info.size()), info.data(), info.size());
+
+		align(file, 8);
+		size_t rela_info_offset = file.size();
+		memcpy(file.append(rela_info.size() * sizeof(ELF::Rela)), &rela_info[0], rela_info.size() * sizeof(ELF::Rela));
+
+		size_t line_offset = file.size();
+		memcpy(file.append(line.size()), line.data(), line.size());
+
+		align(file, 8);
+		size_t rela_line_offset = file.size();
+		memcpy(file.append(rela_line.size() * sizeof(ELF::Rela)), &rela_line[0], rela_line.size() * sizeof(ELF::Rela));
+
+		CodeBuffer shstrtab;
+		add_string(shstrtab, "");
+
+		uint32_t names[NUM_SECTIONS] = {0,
+			(uint32_t)add_string(shstrtab, ".text"),
+			(uint32_t)add_string(shstrtab, ".symtab"),
+			(uint32_t)add_string(shstrtab, ".strtab"),
+			(uint32_t)add_string(shstrtab, ".rela.text"),
+			(uint32_t)add_string(shstrtab, ".debug_abbrev"),
+			(uint32_t)add_string(shstrtab, ".debug_info"),
+			(uint32_t)add_string(shstrtab, ".rela.debug_info"),
+			(uint32_t)add_string(shstrtab, ".debug_line"),
+			(uint32_t)add_string(shstrtab, ".rela.debug_line"),
+			(uint32_t)add_string(shstrtab, ".note.GNU-stack"),
+			(uint32_t)add_string(shstrtab, ".shstrtab"),
+		};
+
+		size_t shstrtab_offset = file.size();
+		memcpy(file.append(shstrtab.size()), shstrtab.data(), shstrtab.size());
+
+		ELF::SectionHeader sections[NUM_SECTIONS] = {
+			{},
+			{names[TEXT], ELF::SecType::SHT_PROGBITS, ELF::SecFlags::SHF_ALLOC | ELF::SecFlags::SHF_EXECINSTR, 0,
+			 text_offset, text_size, 0, 0, 16, 0},
+			{names[SYMTAB], ELF::SecType::SHT_SYMTAB, 0, 0,
+			 symtab_offset, symtab.size() * sizeof(ELF::Symbol), STRTAB, (uint32_t)first_global, 8, sizeof(ELF::Symbol)},
+			{names[STRTAB], ELF::SecType::SHT_STRTAB, 0, 0,
+			 strtab_offset, strtab.size(), 0, 0, 1, 0},
+			{names[RELA_TEXT], ELF::SecType::SHT_RELA, ELF::SecFlags::SHF_INFO_LINK, 0,
+			 rela_offset, rela.size() * sizeof(ELF::Rela), SYMTAB, TEXT, 8, sizeof(ELF::Rela)},
+			{names[DEBUG_ABBREV], ELF::SecType::SHT_PROGBITS, 0, 0,
+			 abbrev_offset, abbrev.size(), 0, 0, 1, 0},
+			{names[DEBUG_INFO], ELF::SecType::SHT_PROGBITS, 0, 0,
+			 info_offset, info.size(), 0, 0, 1, 0},
+			{names[RELA_DEBUG_INFO], ELF::SecType::SHT_RELA, ELF::SecFlags::SHF_INFO_LINK, 0,
+			 rela_info_offset, rela_info.size() * sizeof(ELF::Rela), SYMTAB, DEBUG_INFO, 8, sizeof(ELF::Rela)},
+			{names[DEBUG_LINE], ELF::SecType::SHT_PROGBITS, 0, 0,
+			 line_offset, line.size(), 0, 0, 1, 0},
+			{names[RELA_DEBUG_LINE], ELF::SecType::SHT_RELA, ELF::SecFlags::SHF_INFO_LINK, 0,
+			 rela_line_offset, rela_line.size() * sizeof(ELF::Rela), SYMTAB, DEBUG_LINE, 8, sizeof(ELF::Rela)},
+			{names[NOTE_GNU_STACK], ELF::SecType::SHT_PROGBITS, 0, 0,
+			 shstrtab_offset, 0, 0, 0, 1, 0},
+			{names[SHSTRTAB], ELF::SecType::SHT_STRTAB, 0, 0,
+			 shstrtab_offset, shstrtab.size(), 0, 0, 1, 0},
+		};
+
+		align(file, 8);
+		size_t sections_offset = file.size();
+		memcpy(file.append(sizeof(sections)), sections, sizeof(sections));
+
+		ELF::Header header = {};
+		header.EI_MAG      = ELF::MAG_NUM;
+		header.EI_CLASS    = ELF::IntelExec86_64::CLASS;
+		header.EI_DATA     = ELF::IntelExec86_64::DATA2LSB;
+		header.EI_VERSION  = ELF::IntelExec86_64::EV_CURENT;
+		header.EI_OSABI    = ELF::IntelExec86_64::SYSV_ABI;
+		header.E_TYPE      = ELF::IntelExec86_64::ET_REL;
+		header.E_MACHINE   = ELF::IntelExec86_64::EM;
+		header.E_VERSION   = ELF::IntelExec86_64::EV_CURENT;
+		header.E_SHOFF     = sections_offset;
+		header.E_EHSIZE    = ELF::IntelExec86_64::EHSIZE;
+		header.E_SHENTSIZE = ELF::IntelExec86_64::SHENTSIZE;
+		header.E_SHNUM     = NUM_SECTIONS;
+		header.E_SHSTRNDX  = SHSTRTAB;
+
+		memcpy(file.data(), &header, sizeof(header));
+
+		FILE* output_f = fopen(filename, "wb");
+		if (output_f == nullptr) return false;
+
+		fwrite(file.data(), 1, file.size(), output_f);
+		fclose(output_f);
+
+		return true;
+	}
+
+	void CodeGenerator::dump_stats(FILE* output_f){
+		assert(output_f != nullptr);
+
+		size_t num_loads  = 0;
+		size_t num_stores = 0;
+
+		for (size_t i = 0; i < instructions.size(); ++i){
+			if (Assembly::spec_type(instructions[i]) == Assembly::LOAD)  ++num_loads;
+			if (Assembly::spec_type(instructions[i]) == Assembly::STORE) ++num_stores;
+		}
+
+		fprintf(output_f, "instructions: %zu\n", instructions.size());
+		fprintf(output_f, "frame loads:  %zu\n", num_loads);
+		fprintf(output_f, "frame stores: %zu\n", num_stores);
+
+		CodeBuffer code;
+		fprintf(output_f, "code bytes:   %zu\n", write_elf(code));
+		fprintf(output_f, "short jumps:  %zu\n", num_short_jumps);
+
+		fprintf(output_f, "internal conventions: %zu\n", call_graph->num_internal());
+		if (profile != nullptr) fprintf(output_f, "profile arms swapped: %zu\n", num_swapped_arms);
+		cfg->dump_stats(output_f);
+		peephole->dump_stats(output_f);
+	}
+
 	void CodeGenerator::write_asm(FILE* output_f){
 		assert(output_f != nullptr);
 
+		char line[Assembly::MAX_LINE] = "";
+
+		fprintf(output_f, "section .text\n");
+		fprintf(output_f, "\t\tglobal _start\n");
+
 		for (size_t i = 0; i < instructions.size(); ++i){
-			fprintf(output_f, "%s\n", instructions[i]->assembly());
+			fprintf(output_f, "%s\n", Assembly::assembly(line, instructions[i], symbols));
 		}
 	}
 
@@ -1,11 +1,42 @@
 #pragma once
 #include "../Lib/CompLib.hpp"
+#include "../ELFResearch/ELFformat.hpp"
+#include <sys/stat.h>
+#include <unistd.h>
 #include "../Frontend/ASTree.cpp"
+#include "CallGraph.cpp"
+#include "ControlFlow.cpp"
+#include "ObjectFile.cpp"
+#include "../Optimizer/Profile.cpp"
+#include "../Lib/Runtime.hpp"
 
 namespace CodeGeneratorNS {
+	//right operand of an instruction: a register, an immediate or [rbp + val]
+	struct Operand {
+		Assembly::Registers::Reg reg = Assembly::Registers::NOT_REG;
+		int64_t val = 0;
+		bool is_imm = false;
+		bool is_mem = false;
+	};
+
+	constexpr uint32_t NO_COUNTER = UINT32_MAX;
+
+	//row of the line table: code from offset on comes from line
+	struct LineRow {
+		uint32_t offset;
+		uint32_t line;
+	};
+
+	class JitCode;
+	class LazyJitCode;
+
 	class CodeGenerator {
 	private:
-		Vector<Assembly::Instruction*> instructions;
+		friend class JitCode;
+		friend class LazyJitCode;
+
+		Peephole::Code instructions;
+		Assembly::SymbolTable symbols;
 
 		ASTreeNS::ASTNode_t* cur = nullptr;
 
@@ -13,31 +44,88 @@ namespace CodeGeneratorNS {
 		void generate_operator(ASTreeNS::ASTNode_t* node);
 		void generate_var_declaration(ASTreeNS::ASTNode_t* node);
 		void generate_expression(ASTreeNS::ASTNode_t* node);
+		void generate_subexpression(ASTreeNS::ASTNode_t* node, const Assembly::Registers::Reg* regs, size_t num_regs);
+		Operand generate_operands(ASTreeNS::ASTNode_t* lhs, ASTreeNS::ASTNode_t* rhs, const Assembly::Registers::Reg* regs, size_t num_regs);
+		void generate_arithmetic(Operator::code code, Assembly::Registers::Reg dst, Operand src);
+		void generate_compare(Assembly::Registers::Reg dst, Operand src);
+		bool generate_address(ASTreeNS::ASTNode_t* node, Assembly::Registers::Reg dst);
+		size_t count_registers(ASTreeNS::ASTNode_t* node, bool is_right);
+		bool is_leaf(ASTreeNS::ASTNode_t* node);
+		bool swaps_operands(ASTreeNS::ASTNode_t* node);
+		Operand leaf_operand(ASTreeNS::ASTNode_t* node);
+		int64_t literal(ASTreeNS::ASTNode_t* node);
+		bool is_imm32_literal(ASTreeNS::ASTNode_t* node);
+		Operator::code swap_comparison(Operator::code code);
+		Assembly::Registers::Reg var_register(ASTreeNS::ASTNode_t* node);
+		bool references(ASTreeNS::ASTNode_t* node, const char* var);
 		void generate_var_init(ASTreeNS::ASTNode_t* node);
 		void generate_func_declaration(ASTreeNS::ASTNode_t* node);
 		void generate_block(ASTreeNS::ASTNode_t* node);
+		void generate_block(ASTreeNS::ASTNode_t* node, Assembly::Symbol label, uint32_t counter = NO_COUNTER);
+		void generate_arm(ASTreeNS::ASTNode_t* node, Assembly::Symbol label, const TokenizerNS::Token& branch, Counter::Kind kind);
+		void generate_counter(uint32_t counter);
+		uint32_t counter_key(const TokenizerNS::Token& key, Counter::Kind kind);
+		void runtime_calls(Vector<const char*>& names); //what generated code may call in the runtime
 		void generate_return(ASTreeNS::ASTNode_t* node);
-		void push_arguments(ASTreeNS::ASTNode_t* node, size_t& num_args);
+		void generate_call(ASTreeNS::ASTNode_t* node);
+		void push_arguments(Vector<ASTreeNS::ASTNode_t*>& args, size_t num_reg_args, const Convention& conv);
+		void move_arguments(Vector<ASTreeNS::ASTNode_t*>& args, size_t num_reg_args, const Convention& conv);
 		void generate_branching(ASTreeNS::ASTNode_t* node);
 		void generate_exit(ASTreeNS::ASTNode_t* node);
 		void generate_print(ASTreeNS::ASTNode_t* node);
+		void generate_input(ASTreeNS::ASTNode_t* node);
+		void generate_epilogue();
+		void generate_shared_epilogue();
 
-		HashTable<const char*, int32_t, hash, strcmp, 509>* local_offsets = nullptr;
-		size_t cur_local_vars_num = 0;
-		size_t cur_local_args_num = 0;
+		CallGraph* call_graph = nullptr;
+		ControlFlowGraph*  cfg      = nullptr;
+		PeepholeOptimizer* peephole = nullptr;
 
-		size_t num_blocks = 0;
+		HashTable<const char*, Location, hash, strcmp, 509>* locations = nullptr;
+		size_t cur_frame_slots = 0;
 
-		void count_local_offsets(ASTreeNS::ASTNode_t* node, size_t& num_vars);
-		void count_function_arguments(ASTreeNS::ASTNode_t* node, size_t& num_args);
+		Assembly::Registers::Reg saved_regs[Allocation::POOL_SIZE] = {};
+		int32_t saved_offsets[Allocation::POOL_SIZE] = {};
+		size_t num_saved_regs = 0;
+		Assembly::Symbol cur_epilogue; //block of the shared epilogue
+
+		bool is_instrumented = false;
+		const OptimizerNS::Profile* profile = nullptr;
+		uint64_t cur_entries    = 0; //of the current Theurgy in the profile
+		size_t num_swapped_arms = 0;
+
+		size_t num_short_jumps = 0; //rel8 jumps chosen by the last write_elf
+		Vector<int32_t> label_offsets; //of the last write_elf, -1 for symbols outside the code
+		Vector<Assembly::Fixup> relocations; //of the last write_elf, positions are relative to its start
+		Vector<LineRow> line_rows; //of the last write_elf, one per change of the source line
+
+		void assign_locations(RegisterAllocator& allocator, const Convention& conv);
+		void load_var(Assembly::Registers::Reg dst, const char* var);
+		void store_var(const char* var, Assembly::Registers::Reg src);
+
+		void place_labels(Vector<uint8_t>& is_short);
+		void relax_jumps (Vector<uint8_t>& is_short);
+		size_t function_size(size_t label, size_t code_size);
+
+		size_t add_string(CodeBuffer& table, const char* str);
+		void   add_uleb(CodeBuffer& buf, uint64_t value);
+		void   add_sleb(CodeBuffer& buf, int64_t value);
+		void   align(CodeBuffer& buf, size_t alignment);
 
 	public:
-		CodeGenerator(const ASTreeNS::ASTree& tree);
+		CodeGenerator(const ASTreeNS::ASTree& tree, bool is_lazy = false, bool is_instrumented = false,
+		              const OptimizerNS::Profile* profile = nullptr);
+
+		bool generate_function(const char* name);
 
 		void write_asm(const char* filename);
 		void write_asm(FILE* output_f);
 
-		size_t write_elf(uint8_t* buf);
+		size_t write_elf(CodeBuffer& buf);
+		bool   write_exe(const char* filename, const char* runtime_name = Linking::RUNTIME_OBJ);
+		bool   write_obj(const char* filename, const char* source);
+
+		void dump_stats(FILE* output_f);
 			
 	};
 };
@@ -0,0 +1,434 @@
+#pragma once
+#include "ControlFlow.hpp"
+
+namespace CodeGeneratorNS {
+	namespace ControlFlow {
+		Assembly::Opcodes::Op inverse(Assembly::Opcodes::Op code){
+			switch (code){
+				case Assembly::Opcodes::JZ:  return Assembly::Opcodes::JNZ;
+				case Assembly::Opcodes::JNZ: return Assembly::Opcodes::JZ;
+				case Assembly::Opcodes::JG:  return Assembly::Opcodes::JLE;
+				case Assembly::Opcodes::JLE: return Assembly::Opcodes::JG;
+				case Assembly::Opcodes::JL:  return Assembly::Opcodes::JGE;
+				case Assembly::Opcodes::JGE: return Assembly::Opcodes::JL;
+				default:
+					assert("Not a conditional jump" && false);
+			}
+
+			return Assembly::Opcodes::NONE;
+		}
+
+		bool is_jump(Assembly::Opcodes::Op code){
+			return code == Assembly::Opcodes::JMP || Peephole::is_conditional_jump(code);
+		}
+	};
+
+	ControlFlowGraph::ControlFlowGraph(Peephole::Code& code, Assembly::SymbolTable& symbols): code(code), symbols(symbols) {}
+
+	ControlFlowGraph::~ControlFlowGraph(){
+		clear();
+	}
+
+	void ControlFlowGraph::clear(){
+		while (head != nullptr){
+			BasicBlock* next = head->next;
+			delete head;
+			head = next;
+		}
+	}
+
+	void ControlFlowGraph::mark_cold(Assembly::Symbol label){
+		assert(label.id != Assembly::NO_LABEL);
+
+		while (cold_labels.size() <= (size_t)label.id) cold_labels.push_back(false);
+
+		cold_labels[label.id] = true;
+	}
+
+	void ControlFlowGraph::run(){
+		build();
+		move_cold_blocks();
+
+		bool is_changed = true;
+
+		while (is_changed){
+			is_changed = false;
+
+			is_changed |= thread_jumps();
+			is_changed |= invert_branches();
+			is_changed |= remove_jumps_to_next();
+			is_changed |= remove_unreachable();
+			is_changed |= merge_blocks();
+		}
+
+		linearize();
+		cold_labels.resize(0);
+	}
+
+	// Blocks start at labels and right after jumps and returns.
+	void ControlFlowGraph::build(){
+		clear();
+
+		BasicBlock* cur = new BasicBlock();
+		cur->is_entry = true;
+		head = cur;
+
+		labeled.resize(symbols.size());
+		for (size_t i = 0; i < labeled.size(); ++i) labeled[i] = nullptr;
+
+		bool is_closed = false;
+
+		for (size_t i = 0; i < code.size(); ++i){
+			Assembly::Instruction ops = code[i];
+
+			if (is_closed || (ops.op == Assembly::Opcodes::LABEL && cur->body.size() != 0)){
+				insert_after(cur, new BasicBlock());
+
+				//only reached from the cold block before it
+				cur->next->is_cold = cur->is_cold && ops.op != Assembly::Opcodes::LABEL;
+				cur = cur->next;
+				is_closed = false;
+			}
+
+			if (ops.op == Assembly::Opcodes::LABEL){
+				cur->labels.push_back(code[i], code.lines[i]);
+
+				labeled[ops.label] = cur;
+				if (symbols.is_named(ops.label)) cur->is_entry = true;
+				if ((size_t)ops.label < cold_labels.size() && cold_labels[ops.label]) cur->is_cold = true;
+
+				continue;
+			}
+
+			cur->body.push_back(code[i], code.lines[i]);
+			is_closed = ControlFlow::is_jump(ops.op) || ops.op == Assembly::Opcodes::RET;
+		}
+	}
+
+	Assembly::Instruction ControlFlowGraph::closing(BasicBlock* block){
+		if (block->body.size() == 0) return {};
+
+		return block->body[block->body.size() - 1];
+	}
+
+	bool ControlFlowGraph::falls_through(BasicBlock* block){
+		Assembly::Opcodes::Op code = closing(block).op;
+
+		return code != Assembly::Opcodes::JMP && code != Assembly::Opcodes::RET;
+	}
+
+	BasicBlock* ControlFlowGraph::target(const Assembly::Instruction& jump){
+		return labeled[jump.label];
+	}
+
+	void ControlFlowGraph::link(){
+		for (BasicBlock* block = head; block != nullptr; block = block->next){
+			block->num_preds = 0;
+			block->taken = nullptr;
+		}
+
+		for (BasicBlock* block = head; block != nullptr; block = block->next){
+			Assembly::Instruction ops = closing(block);
+
+			if (ControlFlow::is_jump(ops.op)){
+				block->taken = target(ops);
+				if (block->taken != nullptr) ++block->taken->num_preds;
+			}
+
+			if (falls_through(block) && block->next != nullptr) ++block->next->num_preds;
+		}
+	}
+
+	void ControlFlowGraph::retarget(BasicBlock* block, BasicBlock* dst){
+		assert(dst->labels.size() != 0);
+
+		Assembly::Instruction label = dst->labels[0];
+		Assembly::Instruction jump  = closing(block);
+
+		jump.label = label.label;
+
+		block->body[block->body.size() - 1] = jump;
+	}
+
+	void ControlFlowGraph::unlink(BasicBlock* block){
+		if (block->prev != nullptr) block->prev->next = block->next;
+		if (block->next != nullptr) block->next->prev = block->prev;
+
+		block->prev = nullptr;
+		block->next = nullptr;
+	}
+
+	void ControlFlowGraph::insert_after(BasicBlock* pos, BasicBlock* block){
+		block->prev = pos;
+		block->next = pos->next;
+
+		if (pos->next != nullptr) pos->next->prev = block;
+		pos->next = block;
+	}
+
+	void ControlFlowGraph::drop_closing(BasicBlock* block){
+		block->body.resize(block->body.size() - 1);
+	}
+
+	// jmp A; A: jmp B  =>  jmp B, the same for conditional jumps and empty blocks
+	bool ControlFlowGraph::thread_jumps(){
+		link();
+		bool is_changed = false;
+
+		for (BasicBlock* block = head; block != nullptr; block = block->next){
+			if (block->taken == nullptr) continue;
+
+			BasicBlock* dst = block->taken;
+
+			for (size_t i = 0; i < ControlFlow::MAX_THREADING; ++i){
+				Assembly::Instruction ops = closing(dst);
+
+				if (dst->body.size() == 1 && ops.op == Assembly::Opcodes::JMP && target(ops) != nullptr){
+					dst = target(ops);
+				}
+
+				else if (dst->body.size() == 0 && dst->next != nullptr && dst->next->labels.size() != 0){
+					dst = dst->next;
+				}
+
+				else break;
+			}
+
+			if (dst == block->taken) continue;
+
+			retarget(block, dst);
+			block->taken = dst;
+
+			++num_threaded;
+			is_changed = true;
+		}
+
+		return is_changed;
+	}
+
+	// jcc A; jmp B; A:  =>  jncc B; A:
+	bool ControlFlowGraph::invert_branches(){
+		link();
+		bool is_changed = false;
+
+		for (BasicBlock* block = head; block != nullptr; block = block->next){
+			Assembly::Instruction jcc = closing(block);
+			if (!Peephole::is_conditional_jump(jcc.op)) continue;
+
+			BasicBlock* jmp = block->next;
+			if (jmp == nullptr || jmp->num_preds != 1 || jmp->body.size() != 1) continue;
+			if (closing(jmp).op != Assembly::Opcodes::JMP || jmp->taken == nullptr) continue;
+			if (jmp->next != block->taken) continue;
+
+			jcc.op = ControlFlow::inverse(jcc.op);
+
+			block->body[block->body.size() - 1] = jcc;
+
+			retarget(block, jmp->taken);
+			drop_closing(jmp);
+
+			++num_inverted;
+			is_changed = true;
+		}
+
+		return is_changed;
+	}
+
+	bool ControlFlowGraph::remove_jumps_to_next(){
+		link();
+		bool is_changed = false;
+
+		for (BasicBlock* block = head; block != nullptr; block = block->next){
+			if (block->taken == nullptr) continue;
+
+			BasicBlock* next = block->next;
+			while (next != nullptr && next != block->taken && next->body.size() == 0) next = next->next;
+
+			if (next != block->taken) continue;
+
+			drop_closing(block);
+
+			++num_fallthrough;
+			is_changed = true;
+		}
+
+		return is_changed;
+	}
+
+	bool ControlFlowGraph::remove_unreachable(){
+		link();
+
+		Vector<BasicBlock*> stack;
+
+		for (BasicBlock* block = head; block != nullptr; block = block->next){
+			block->is_reachable = block->is_entry;
+			if (block->is_entry) stack.push_back(block);
+		}
+
+		while (stack.size() != 0){
+			BasicBlock* block = stack[stack.size() - 1];
+			stack.resize(stack.size() - 1);
+
+			BasicBlock* succs[] = {block->taken, (falls_through(block))?(block->next):(nullptr)};
+
+			for (size_t i = 0; i < 2; ++i){
+				if (succs[i] == nullptr || succs[i]->is_reachable) continue;
+
+				succs[i]->is_reachable = true;
+				stack.push_back(succs[i]);
+			}
+		}
+
+		bool is_changed = false;
+
+		for (BasicBlock* block = head; block != nullptr; ){
+			BasicBlock* next = block->next;
+
+			if (!block->is_reachable){
+				num_unreachable += block->body.size();
+
+				for (size_t i = 0; i < block->labels.size(); ++i){
+					labeled[block->labels[i].label] = nullptr;
+				}
+
+				unlink(block);
+				delete block;
+
+				is_changed = true;
+			}
+
+			block = next;
+		}
+
+		return is_changed;
+	}
+
+	// A block only reached by a jmp is pulled right after it, when it does not fall through itself.
+	bool ControlFlowGraph::merge_blocks(){
+		link();
+		bool is_changed = false;
+
+		for (BasicBlock* block = head; block != nullptr; block = block->next){
+			BasicBlock* dst = block->taken;
+
+			if (dst == nullptr || dst == block || dst == block->next) continue;
+			if (closing(block).op != Assembly::Opcodes::JMP) continue;
+			if (dst->is_entry || dst->num_preds != 1 || falls_through(dst)) continue;
+			if (dst->is_cold != block->is_cold) continue;
+
+			unlink(dst);
+			insert_after(block, dst);
+			drop_closing(block);
+
+			++num_merged;
+			is_changed = true;
+
+			link();
+		}
+
+		return is_changed;
+	}
+
+	// Runs of cold blocks move to the end of their Theurgy, so the hot path falls through its
+	// branches. A run that fell through gets a jmp to its old successor. The cleanup passes turn
+	// the jcc/jmp pairs left in front of the hot code into a single jcc to the cold run.
+	bool ControlFlowGraph::move_cold_blocks(){
+		bool is_changed = false;
+
+		for (BasicBlock* first = head; first != nullptr; ){
+			BasicBlock* last = first;
+			while (last->next != nullptr && !last->next->is_entry) last = last->next;
+
+			BasicBlock* stop  = last->next;
+			BasicBlock* block = first->next;
+
+			//nothing can go after code that runs into the next Theurgy
+			if (falls_through(last)) block = stop;
+
+			while (block != stop){
+				if (!block->is_cold || falls_through(block->prev)){
+					block = block->next;
+					continue;
+				}
+
+				BasicBlock* end = block;
+				while (end->next != stop && end->next->is_cold) end = end->next;
+
+				BasicBlock* after = end->next;
+				if (after == stop) break;
+
+				if (falls_through(end)){
+					if (after->labels.size() == 0){
+						block = after;
+						continue;
+					}
+
+					end->body.push_back(Assembly::Jmp({after->labels[0].label}));
+				}
+
+				for (BasicBlock* cur = block; ; ){
+					BasicBlock* next = cur->next;
+
+					unlink(cur);
+					insert_after(last, cur);
+					last = cur;
+
+					++num_cold;
+					if (cur == end) break;
+
+					cur = next;
+				}
+
+				is_changed = true;
+				block = after;
+			}
+
+			first = stop;
+		}
+
+		return is_changed;
+	}
+
+	// Only labels somebody jumps to are written back.
+	void ControlFlowGraph::linearize(){
+		Vector<uint8_t> referenced;
+		referenced.resize(symbols.size());
+
+		for (size_t i = 0; i < referenced.size(); ++i) referenced[i] = false;
+
+		for (BasicBlock* block = head; block != nullptr; block = block->next){
+			Assembly::Instruction ops = closing(block);
+			if (ControlFlow::is_jump(ops.op)) referenced[ops.label] = true;
+		}
+
+		code.resize(0);
+
+		for (BasicBlock* block = head; block != nullptr; block = block->next){
+			for (size_t i = 0; i < block->labels.size(); ++i){
+				Assembly::Instruction label = block->labels[i];
+
+				if (symbols.is_named(label.label) || referenced[label.label]){
+					code.push_back(block->labels[i], block->labels.lines[i]);
+				}
+
+				else ++num_labels;
+			}
+
+			for (size_t i = 0; i < block->body.size(); ++i){
+				code.push_back(block->body[i], block->body.lines[i]);
+			}
+		}
+	}
+
+	void ControlFlowGraph::dump_stats(FILE* output_f){
+		assert(output_f != nullptr);
+
+		fprintf(output_f, "cfg threaded jumps:       %zu\n", num_threaded);
+		fprintf(output_f, "cfg inverted branches:    %zu\n", num_inverted);
+		fprintf(output_f, "cfg jumps to next:        %zu\n", num_fallthrough);
+		fprintf(output_f, "cfg merged blocks:        %zu\n", num_merged);
+		fprintf(output_f, "cfg unreachable removed:  %zu\n", num_unreachable);
+		fprintf(output_f, "cfg labels dropped:       %zu\n", num_labels);
+		fprintf(output_f, "cfg cold blocks moved:    %zu\n", num_cold);
+	}
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include "../Lib/CompLib.hpp"
+#include "Peephole.cpp"
+
+namespace CodeGeneratorNS {
+	namespace ControlFlow {
+		constexpr size_t MAX_THREADING = 16; //jumps followed before a chain is considered a loop
+	};
+
+	struct BasicBlock {
+		Peephole::Code labels;
+		Peephole::Code body; //a jump or ret can only be the last one
+
+		BasicBlock* prev  = nullptr; //layout order
+		BasicBlock* next  = nullptr;
+		BasicBlock* taken = nullptr; //target of the closing jump
+
+		size_t num_preds  = 0;
+		bool is_entry     = false;   //Theurgies and the start of the code
+		bool is_reachable = false;
+		bool is_cold      = false;   //rarely runs in the profile, kept at the end of its Theurgy
+	};
+
+	class ControlFlowGraph {
+	private:
+		Peephole::Code& code;
+		Assembly::SymbolTable& symbols;
+		BasicBlock* head = nullptr;
+
+		Vector<BasicBlock*> labeled; //block of every label id
+		Vector<uint8_t> cold_labels; //by label id, from mark_cold
+
+		size_t num_threaded    = 0;
+		size_t num_inverted    = 0;
+		size_t num_merged      = 0;
+		size_t num_fallthrough = 0;
+		size_t num_unreachable = 0;
+		size_t num_labels      = 0;
+		size_t num_cold        = 0;
+
+		void build();
+		void clear();
+		void link();
+		void linearize();
+
+		Assembly::Instruction closing(BasicBlock* block);
+		bool falls_through(BasicBlock* block);
+		BasicBlock* target(const Assembly::Instruction& jump);
+		void retarget(BasicBlock* block, BasicBlock* dst);
+		void unlink(BasicBlock* block);
+		void insert_after(BasicBlock* pos, BasicBlock* block);
+		void drop_closing(BasicBlock* block);
+
+		bool thread_jumps();
+		bool invert_branches();
+		bool remove_jumps_to_next();
+		bool remove_unreachable();
+		bool merge_blocks();
+		bool move_cold_blocks();
+
+	public:
+		ControlFlowGraph(Peephole::Code& code, Assembly::SymbolTable& symbols);
+		~ControlFlowGraph();
+
+		//the block of label goes out of line in the next run
+		void mark_cold(Assembly::Symbol label);
+
+		void run();
+		void dump_stats(FILE* output_f);
+	};
+};
@@ -0,0 +1,256 @@
+#pragma once
+#include "Interpreter.hpp"
+
+namespace CodeGeneratorNS {
+	Interpreter::Interpreter(const ASTreeNS::ASTree& tree, LazyJitCode& jit, size_t threshold): jit(jit), threshold(threshold) {
+		collect_functions(tree.root());
+
+		is_linked = check_calls(tree.root());
+
+		if (functions.find("_start") == functions.end()){
+			fprintf(stderr, "undefined Theurgy _start\n");
+			is_linked = false;
+		}
+	}
+
+	double Interpreter::now_us(){
+		timespec time = {};
+		clock_gettime(CLOCK_MONOTONIC, &time);
+
+		return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+	}
+
+	void Interpreter::collect_functions(ASTreeNS::ASTNode_t* node){
+		if (node == nullptr) return;
+
+		if (node->key.code == Operator::DEC_FUNC){
+			functions[node->right()->key.lexem].node = node;
+		}
+
+		collect_functions(node->left());
+		collect_functions(node->right());
+	}
+
+	// Every call is checked before the run, tier 0 cannot fail in the middle of one.
+	bool Interpreter::check_calls(ASTreeNS::ASTNode_t* node){
+		if (node == nullptr) return true;
+
+		bool is_defined = true;
+
+		if (node->key.code == Operator::CALL && functions.find(node->right()->key.lexem) == functions.end()){
+			fprintf(stderr, "undefined Theurgy %s\n", node->right()->key.lexem);
+			is_defined = false;
+		}
+
+		bool is_left_defined  = check_calls(node->left());
+		bool is_right_defined = check_calls(node->right());
+
+		return is_defined && is_left_defined && is_right_defined;
+	}
+
+	bool Interpreter::is_ready(){
+		return is_linked;
+	}
+
+	int64_t Interpreter::run(){
+		start_us = now_us();
+
+		int64_t result = call("_start", nullptr, 0);
+		aristotle_flush();
+
+		total_us = now_us() - start_us;
+		return result;
+	}
+
+	void Interpreter::promote(const char* name, Tier::Function& func, size_t num_args){
+		if (num_args <= Tier::MAX_NATIVE_ARGS) func.native = jit.address(name);
+
+		if (func.native == nullptr){
+			func.is_pinned = true;
+			return;
+		}
+
+		promotions.push_back({name, func.num_calls, now_us() - start_us});
+	}
+
+	int64_t Interpreter::call(const char* name, int64_t* args, size_t num_args){
+		//checked by check_calls
+		auto found = functions.find(name);
+		assert(found != functions.end());
+
+		Tier::Function& func = found->second;
+		++func.num_calls;
+
+		if (func.native == nullptr && !func.is_pinned && func.num_calls > threshold){
+			promote(found->first, func, num_args);
+		}
+
+		if (func.native != nullptr) return call_native(func.native, args, num_args);
+
+		return interpret(func, args, num_args);
+	}
+
+	// Native code never calls back into tier 0, so the time spent here does not nest.
+	int64_t Interpreter::call_native(void* native, int64_t* args, size_t num_args){
+		double start = now_us();
+		int64_t result = 0;
+
+		switch (num_args){
+			case 0: result = reinterpret_cast<int64_t (*)()>(native)(); break;
+			case 1: result = reinterpret_cast<int64_t (*)(int64_t)>(native)(args[0]); break;
+			case 2: result = reinterpret_cast<int64_t (*)(int64_t, int64_t)>(native)(args[0], args[1]); break;
+			case 3: result = reinterpret_cast<int64_t (*)(int64_t, int64_t, int64_t)>(native)(args[0], args[1], args[2]); break;
+			case 4: result = reinterpret_cast<int64_t (*)(int64_t, int64_t, int64_t, int64_t)>(native)(args[0], args[1], args[2], args[3]); break;
+			case 5: result = reinterpret_cast<int64_t (*)(int64_t, int64_t, int64_t, int64_t, int64_t)>(native)(args[0], args[1], args[2], args[3], args[4]); break;
+			case 6: result = reinterpret_cast<int64_t (*)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t)>(native)(args[0], args[1], args[2], args[3], args[4], args[5]); break;
+			default: assert("Too many arguments for a native call" && false);
+		}
+
+		native_us += now_us() - start;
+		return result;
+	}
+
+	int64_t Interpreter::interpret(Tier::Function& func, int64_t* args, size_t num_args){
+		Tier::Frame frame;
+		size_t i = 0;
+
+		for (ASTreeNS::ASTNode_t* comma = func.node->left(); comma != nullptr && comma->right() != nullptr; comma = comma->left()){
+			variable(frame, comma->right()->key.lexem) = (i < num_args)?(args[i]):(0);
+			++i;
+		}
+
+		execute_block(func.node->right()->right(), frame);
+
+		return frame.result;
+	}
+
+	int64_t& Interpreter::variable(Tier::Frame& frame, const char* name){
+		for (size_t i = 0; i < frame.vars.size(); ++i){
+			if (strcmp(frame.vars[i], name) == 0) return frame.vals[i];
+		}
+
+		frame.vars.push_back(name);
+		frame.vals.push_back(0);
+
+		return frame.vals[frame.vals.size() - 1];
+	}
+
+	void Interpreter::execute_block(ASTreeNS::ASTNode_t* node, Tier::Frame& frame){
+		assert(node != nullptr);
+		assert(node->key.code == Operator::BLOCK);
+
+		while (node != nullptr && node->right() != nullptr && !frame.is_returned){
+			execute(node->right(), frame);
+
+			node = node->left();
+		}
+	}
+
+	void Interpreter::execute(ASTreeNS::ASTNode_t* node, Tier::Frame& frame){
+		assert(node != nullptr);
+
+		switch (node->key.code){
+		case Operator::IF: {
+			ASTreeNS::ASTNode_t* cond = node->left();
+			bool is_taken = compare(cond->key.code, evaluate(cond->left(), frame), evaluate(cond->right(), frame));
+
+			execute_block((is_taken)?(node->right()->right()):(node->right()->left()), frame);
+			break;
+		}
+		case Operator::DEC_VAR:
+			variable(frame, node->right()->key.lexem) = 0;
+			break;
+		case Operator::ASSGN:
+			frame.last = evaluate(node->right(), frame);
+			variable(frame, node->left()->key.lexem) = frame.last;
+			break;
+		case Operator::RETURN:
+			frame.result = evaluate(node->right(), frame);
+			frame.is_returned = true;
+			break;
+		case Operator::CALL:
+			frame.last = evaluate_call(node, frame);
+			break;
+		case Operator::WRITE:
+			frame.last = evaluate(node->right(), frame);
+			aristotle_write_num(frame.last);
+			break;
+		case Operator::READ:
+			variable(frame, node->right()->key.lexem) = aristotle_read_num();
+			break;
+		case Operator::EXIT:
+			frame.result = frame.last;
+			frame.is_returned = true;
+			break;
+		case Operator::SQRT:
+			//no code is generated for it natively either
+			break;
+		default:
+			printf("Wrong operator %s\n", node->key.lexem);
+			break;
+		}
+	}
+
+	bool Interpreter::compare(Operator::code code, int64_t lhs, int64_t rhs){
+		switch (code){
+			case Operator::EQL:    return lhs == rhs;
+			case Operator::NEQL:   return lhs != rhs;
+			case Operator::LESS:   return lhs <  rhs;
+			case Operator::MORE:   return lhs >  rhs;
+			case Operator::EQLESS: return lhs <= rhs;
+			case Operator::EQMORE: return lhs >= rhs;
+
+			default:
+				assert("Wrong branching format" && false);
+				return false;
+		}
+	}
+
+	int64_t Interpreter::evaluate(ASTreeNS::ASTNode_t* node, Tier::Frame& frame){
+		assert(node != nullptr);
+
+		if (node->key.type == TokenizerNS::NUM) return strtoll(node->key.lexem, nullptr, 10);
+		if (node->key.type == TokenizerNS::ID)  return variable(frame, node->key.lexem);
+
+		if (node->key.code == Operator::CALL) return evaluate_call(node, frame);
+
+		int64_t lhs = evaluate(node->left(),  frame);
+		int64_t rhs = evaluate(node->right(), frame);
+
+		//wraps around like the native code does
+		switch (node->key.code){
+			case Operator::ADD: return (int64_t)((uint64_t)lhs + (uint64_t)rhs);
+			case Operator::SUB: return (int64_t)((uint64_t)lhs - (uint64_t)rhs);
+			case Operator::MUL: return (int64_t)((uint64_t)lhs * (uint64_t)rhs);
+			case Operator::DIV: return lhs / rhs;
+
+			default:
+				assert("Unknown operator code" && false);
+				return 0;
+		}
+	}
+
+	int64_t Interpreter::evaluate_call(ASTreeNS::ASTNode_t* node, Tier::Frame& frame){
+		assert(node->key.code == Operator::CALL);
+
+		Vector<int64_t> args(Tier::FRAME_VARS);
+
+		for (ASTreeNS::ASTNode_t* comma = node->left(); comma != nullptr && comma->right() != nullptr; comma = comma->left()){
+			args.push_back(evaluate(comma->right(), frame));
+		}
+
+		return call(node->right()->key.lexem, &args[0], args.size());
+	}
+
+	void Interpreter::dump_stats(FILE* output_f){
+		assert(output_f != nullptr);
+
+		fprintf(output_f, "tier 0 time:  %.0f us\n", total_us - native_us);
+		fprintf(output_f, "native time:  %.0f us (compilation included)\n", native_us);
+		fprintf(output_f, "compiled Theurgies: %zu\n", jit.compiled());
+
+		for (size_t i = 0; i < promotions.size(); ++i){
+			fprintf(output_f, "promoted %s after %zu calls at %.0f us\n", promotions[i].name, promotions[i].num_calls, promotions[i].at_us);
+		}
+	}
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include "Jit.cpp"
+#include <time.h>
+
+namespace CodeGeneratorNS {
+	namespace Tier {
+		constexpr size_t PROMOTE_AFTER   = 50; //calls interpreted before a Theurgy is compiled
+		constexpr size_t FRAME_VARS      = 16; //Ideas and arguments a frame has room for before it grows
+		constexpr size_t MAX_NATIVE_ARGS = 6;  //only register arguments are passed to native code
+
+		struct Function {
+			ASTreeNS::ASTNode_t* node = nullptr;
+			size_t num_calls = 0;
+			void* native = nullptr;   //entry point once promoted
+			bool is_pinned = false;   //cannot be called natively, stays in tier 0
+		};
+
+		struct Promotion {
+			const char* name;
+			size_t num_calls;
+			double at_us; //since the start of the run
+		};
+
+		struct Frame {
+			Vector<const char*> vars{FRAME_VARS};
+			Vector<int64_t> vals{FRAME_VARS};
+
+			bool is_returned = false;
+			int64_t result = 0;
+			int64_t last   = 0; //value of the last statement, what Thanks returns natively
+		};
+	};
+
+	// Tier 0 walks the AST directly and counts calls of every Theurgy. Once a Theurgy has been
+	// called PROMOTE_AFTER times, it is handed to the lazy JIT and its next call runs natively,
+	// together with everything it calls. Theurgies with an internal convention cannot be called
+	// from here and are only promoted along with a native caller.
+	class Interpreter {
+	private:
+		LazyJitCode& jit;
+		size_t threshold;
+
+		std::map<const char*, Tier::Function, str_less> functions;
+		Vector<Tier::Promotion> promotions;
+		bool is_linked = false; //_start and every called Theurgy are defined
+
+		double start_us  = 0;
+		double native_us = 0;
+		double total_us  = 0;
+
+		static double now_us();
+
+		void collect_functions(ASTreeNS::ASTNode_t* node);
+		bool check_calls(ASTreeNS::ASTNode_t* node);
+		void promote(const char* name, Tier::Function& func, size_t num_args);
+
+		int64_t call(const char* name, int64_t* args, size_t num_args);
+		int64_t call_native(void* native, int64_t* args, size_t num_args);
+		int64_t interpret(Tier::Function& func, int64_t* args, size_t num_args);
+
+		void execute_block(ASTreeNS::ASTNode_t* node, Tier::Frame& frame);
+		void execute(ASTreeNS::ASTNode_t* node, Tier::Frame& frame);
+		int64_t evaluate(ASTreeNS::ASTNode_t* node, Tier::Frame& frame);
+		int64_t evaluate_call(ASTreeNS::ASTNode_t* node, Tier::Frame& frame);
+		bool compare(Operator::code code, int64_t lhs, int64_t rhs);
+
+		int64_t& variable(Tier::Frame& frame, const char* name);
+
+	public:
+		Interpreter(const ASTreeNS::ASTree& tree, LazyJitCode& jit, size_t threshold = Tier::PROMOTE_AFTER);
+
+		bool is_ready();
+		int64_t run();
+		void dump_stats(FILE* output_f);
+	};
+};
@@ -0,0 +1,437 @@
+#pragma once
+#include "Jit.hpp"
+
+//first call of a lazy Theurgy: the stub has pushed its own address, every register may hold an argument
+extern "C" void aristotle_jit_lazy_entry();
+extern "C" const void* aristotle_jit_compile(CodeGeneratorNS::Jit::LazyStub* stub);
+
+asm(R"(
+	.intel_syntax noprefix
+	.text
+	.globl aristotle_jit_lazy_entry
+aristotle_jit_lazy_entry:
+	push rax
+	push rcx
+	push rdx
+	push rbx
+	push rbp
+	push rsi
+	push rdi
+	push r8
+	push r9
+	push r10
+	push r11
+	push r12
+	push r13
+	push r14
+	push r15
+	mov rdi, [rsp + 120]
+	mov rbx, rsp
+	and rsp, -16
+	call aristotle_jit_compile@PLT
+	mov rsp, rbx
+	mov [rsp + 120], rax
+	pop r15
+	pop r14
+	pop r13
+	pop r12
+	pop r11
+	pop r10
+	pop r9
+	pop r8
+	pop rdi
+	pop rsi
+	pop rbp
+	pop rbx
+	pop rdx
+	pop rcx
+	pop rax
+	ret
+	.att_syntax prefix
+)");
+
+namespace CodeGeneratorNS {
+	namespace Jit {
+		const Import RUNTIME[] = {
+			{"_write_num", reinterpret_cast<const void*>(_write_num), 0},
+			{"_read_num",  reinterpret_cast<const void*>(_read_num),  0},
+			{"_count",     reinterpret_cast<const void*>(_count),     0},
+		};
+
+		const size_t RUNTIME_SIZE = sizeof(RUNTIME) / sizeof(RUNTIME[0]);
+
+		const Import* find_import(const Import* imports, size_t num_imports, const char* name){
+			for (size_t i = 0; i < num_imports; ++i){
+				if (strcmp(imports[i].name, name) == 0) return &imports[i];
+			}
+
+			return nullptr;
+		}
+
+		void write_stub(uint8_t* stub, const void* address){
+			stub[0] = 0xFF;
+			stub[1] = 0x25;
+			memset(stub + 2, 0, 4);
+			memcpy(stub + 6, &address, 8);
+		}
+
+		PerfMap::~PerfMap(){
+			if (map_f != nullptr) fclose(map_f);
+		}
+
+		//opened by the first entry, flushed right away since perf may read it while the process runs
+		void PerfMap::add(const void* start, size_t size, const char* name){
+			if (map_f == nullptr && !is_failed){
+				char filename[64] = "";
+				snprintf(filename, sizeof(filename), "/tmp/perf-%d.map", (int)getpid());
+
+				map_f = fopen(filename, "a");
+				if (map_f == nullptr) perror(filename);
+
+				is_failed = map_f == nullptr;
+			}
+
+			if (map_f == nullptr) return;
+
+			fprintf(map_f, "%lx %zx %s\n", (unsigned long)(uintptr_t)start, size, name);
+			fflush(map_f);
+		}
+	};
+
+	JitCode::JitCode(CodeGenerator& gen, const Jit::Import* imports, size_t num_imports): gen(gen) {
+		CodeBuffer code;
+		code_size = gen.write_elf(code);
+
+		link(code, imports, num_imports);
+	}
+
+	JitCode::~JitCode(){
+		if (pages != nullptr) munmap(pages, pages_size);
+	}
+
+	// Every import that is referenced gets a slot after the code: a stub that jumps to the function,
+	// since rel32 cannot reach the host from the low 2GB, or a copy of the data.
+	bool JitCode::link(CodeBuffer& code, const Jit::Import* imports, size_t num_imports){
+		Vector<Assembly::Fixup>& refs = gen.relocations;
+
+		Vector<int32_t> slots;
+		slots.resize(num_imports);
+
+		for (size_t i = 0; i < num_imports; ++i) slots[i] = -1;
+
+		for (size_t i = 0; i < refs.size(); ++i){
+			const char* name = gen.symbols.name(refs[i].label);
+			const Jit::Import* import = Jit::find_import(imports, num_imports, name);
+
+			if (import == nullptr){
+				fprintf(stderr, "undefined symbol %s\n", name);
+				return false;
+			}
+
+			if (refs[i].op != Assembly::Opcodes::LOAD_LABEL && import->size != 0){
+				fprintf(stderr, "%s is called but is not a function\n", name);
+				return false;
+			}
+
+			size_t index = import - imports;
+			if (slots[index] != -1) continue;
+
+			slots[index] = code.size();
+
+			if (import->size != 0){
+				memcpy(code.append(import->size), import->address, import->size);
+				continue;
+			}
+
+			Jit::write_stub(code.append(Jit::STUB_SIZE), import->address);
+		}
+
+		pages_size = code.size();
+		void* mapping = mmap(nullptr, pages_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+
+		if (mapping == MAP_FAILED){
+			perror("mmap");
+			return false;
+		}
+
+		pages = static_cast<uint8_t*>(mapping);
+		memcpy(pages, code.data(), pages_size);
+
+		for (size_t i = 0; i < refs.size(); ++i){
+			assert(refs[i].size == 4);
+
+			int32_t slot = slots[Jit::find_import(imports, num_imports, gen.symbols.name(refs[i].label)) - imports];
+			int32_t value = 0;
+
+			if (refs[i].op == Assembly::Opcodes::LOAD_LABEL) value = (int32_t)(uintptr_t)(pages + slot);
+			else                                             value = slot - (int32_t)(refs[i].pos + 4);
+
+			memcpy(pages + refs[i].pos, &value, 4);
+		}
+
+		if (mprotect(pages, pages_size, PROT_READ | PROT_EXEC) != 0){
+			perror("mprotect");
+			munmap(pages, pages_size);
+			pages = nullptr;
+			return false;
+		}
+
+		return true;
+	}
+
+	bool JitCode::is_ready(){
+		return pages != nullptr;
+	}
+
+	void* JitCode::address(const char* name){
+		assert(name != nullptr);
+
+		if (!is_ready()) return nullptr;
+
+		int32_t id = gen.symbols.find(name);
+		if (id == Assembly::NO_LABEL || gen.label_offsets[id] == -1) return nullptr;
+
+		if (!gen.call_graph->convention(name).is_standard) return nullptr;
+
+		return pages + gen.label_offsets[id];
+	}
+
+	bool JitCode::run(long& result){
+		long (*start)() = function<long (*)()>("_start");
+
+		if (start == nullptr){
+			fprintf(stderr, "undefined Theurgy _start\n");
+			return false;
+		}
+
+		result = start();
+		aristotle_flush();
+
+		return true;
+	}
+
+	void JitCode::write_perf_map(Jit::PerfMap& map){
+		if (!is_ready()) return;
+
+		for (size_t i = 0; i < gen.symbols.size(); ++i){
+			if (!gen.symbols.is_named(i) || gen.label_offsets[i] == -1) continue;
+
+			map.add(pages + gen.label_offsets[i], gen.function_size(i, code_size), gen.symbols.name(i));
+		}
+	}
+
+	LazyJitCode::LazyJitCode(CodeGenerator& gen, const Jit::Import* imports, size_t num_imports):
+		gen(gen), imports(imports), num_imports(num_imports) {
+
+		import_slots.resize(num_imports);
+		for (size_t i = 0; i < num_imports; ++i) import_slots[i] = nullptr;
+
+		void* mapping = mmap(nullptr, Jit::ARENA_SIZE, PROT_READ | PROT_WRITE,
+		                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT | MAP_NORESERVE, -1, 0);
+
+		if (mapping == MAP_FAILED){
+			perror("mmap");
+			return;
+		}
+
+		arena = static_cast<uint8_t*>(mapping);
+
+		Jit::write_stub(allocate(Jit::STUB_SIZE), reinterpret_cast<const void*>(aristotle_jit_lazy_entry));
+
+		if (!set_writable(false) || !is_linkable()){
+			munmap(arena, Jit::ARENA_SIZE);
+			arena = nullptr;
+		}
+	}
+
+	// Whatever compiled code can call outside the Theurgies has to be imported. It is checked before
+	// the first call, since a Theurgy compiled in the middle of a run has no way to fail.
+	bool LazyJitCode::is_linkable(){
+		Vector<const char*> names;
+
+		gen.call_graph->externals(names);
+		gen.runtime_calls(names);
+
+		for (size_t i = 0; i < names.size(); ++i){
+			const Jit::Import* import = Jit::find_import(imports, num_imports, names[i]);
+
+			if (import == nullptr || import->size != 0){
+				fprintf(stderr, "undefined symbol %s\n", names[i]);
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	LazyJitCode::~LazyJitCode(){
+		if (arena != nullptr) munmap(arena, Jit::ARENA_SIZE);
+	}
+
+	uint8_t* LazyJitCode::allocate(size_t size){
+		uint8_t* place = arena + used;
+		used += (size + 15) & ~(size_t)15;
+
+		if (used > Jit::ARENA_SIZE){
+			fprintf(stderr, "JIT arena is full\n");
+			abort();
+		}
+
+		return place;
+	}
+
+	bool LazyJitCode::set_writable(bool is_writable){
+		int prot = (is_writable)?(PROT_READ | PROT_WRITE):(PROT_READ | PROT_EXEC);
+
+		if (mprotect(arena, Jit::ARENA_SIZE, prot) == 0) return true;
+
+		perror("mprotect");
+		return false;
+	}
+
+	// Theurgies get their stub the first time they are referenced, the arena has to be writable.
+	size_t LazyJitCode::find_function(const char* name){
+		for (size_t i = 0; i < functions.size(); ++i){
+			if (strcmp(functions[i].name, name) == 0) return i;
+		}
+
+		FuncInfo* func = gen.call_graph->find(name);
+		assert(func != nullptr);
+
+		Jit::LazyStub* stub = reinterpret_cast<Jit::LazyStub*>(allocate(sizeof(Jit::LazyStub)));
+		stub->jit   = this;
+		stub->index = functions.size();
+
+		uint32_t self = (uint32_t)(uintptr_t)stub;
+		int32_t  rel  = (int32_t)(arena - (stub->code + 10));
+
+		stub->code[0] = 0x68; //push imm32
+		memcpy(stub->code + 1, &self, 4);
+		stub->code[5] = 0xE9; //jmp rel32
+		memcpy(stub->code + 6, &rel, 4);
+
+		functions.push_back({func->node->right()->key.lexem, stub, nullptr});
+		return functions.size() - 1;
+	}
+
+	uint8_t* LazyJitCode::import_slot(const Jit::Import* import){
+		size_t index = import - imports;
+		if (import_slots[index] != nullptr) return import_slots[index];
+
+		if (import->size == 0){
+			import_slots[index] = allocate(Jit::STUB_SIZE);
+			Jit::write_stub(import_slots[index], import->address);
+		}
+
+		else {
+			import_slots[index] = allocate(import->size);
+			memcpy(import_slots[index], import->address, import->size);
+		}
+
+		return import_slots[index];
+	}
+
+	const void* LazyJitCode::link_target(const Assembly::Fixup& ref){
+		const char* name = gen.symbols.name(ref.label);
+
+		if (gen.call_graph->find(name) != nullptr){
+			Jit::LazyFunction& func = functions[find_function(name)];
+
+			return (func.code != nullptr)?(static_cast<void*>(func.code)):(static_cast<void*>(func.stub));
+		}
+
+		//checked by is_linkable
+		const Jit::Import* import = Jit::find_import(imports, num_imports, name);
+		assert(import != nullptr);
+
+		return import_slot(import);
+	}
+
+	const void* LazyJitCode::compile(size_t index){
+		assert(index < functions.size());
+
+		if (functions[index].code != nullptr) return functions[index].code;
+
+		bool is_generated = gen.generate_function(functions[index].name);
+		assert(is_generated);
+
+		CodeBuffer code;
+		gen.write_elf(code);
+
+		if (!set_writable(true)) abort();
+
+		uint8_t* place = allocate(code.size());
+		memcpy(place, code.data(), code.size());
+
+		Vector<Assembly::Fixup>& refs = gen.relocations;
+
+		for (size_t i = 0; i < refs.size(); ++i){
+			assert(refs[i].size == 4);
+
+			const uint8_t* target = static_cast<const uint8_t*>(link_target(refs[i]));
+			int32_t value = 0;
+
+			if (refs[i].op == Assembly::Opcodes::LOAD_LABEL) value = (int32_t)(uintptr_t)target;
+			else                                             value = (int32_t)(target - (place + refs[i].pos + 4));
+
+			memcpy(place + refs[i].pos, &value, 4);
+		}
+
+		int32_t id = gen.symbols.find(functions[index].name);
+		functions[index].code = place + gen.label_offsets[id];
+
+		if (perf_map != nullptr) perf_map->add(functions[index].code, gen.function_size(id, code.size()), functions[index].name);
+
+		Jit::LazyStub* stub = functions[index].stub;
+		int32_t rel = (int32_t)(functions[index].code - (stub->code + 5));
+
+		stub->code[0] = 0xE9; //jmp rel32
+		memcpy(stub->code + 1, &rel, 4);
+
+		if (!set_writable(false)) abort();
+
+		++num_compiled;
+		return functions[index].code;
+	}
+
+	void LazyJitCode::set_perf_map(Jit::PerfMap& map){
+		perf_map = &map;
+	}
+
+	bool LazyJitCode::is_ready(){
+		return arena != nullptr;
+	}
+
+	void* LazyJitCode::address(const char* name){
+		assert(name != nullptr);
+
+		if (!is_ready()) return nullptr;
+
+		FuncInfo* func = gen.call_graph->allocate(name);
+		if (func == nullptr || !func->conv.is_standard) return nullptr;
+
+		if (!set_writable(true)) return nullptr;
+		Jit::LazyStub* stub = functions[find_function(name)].stub;
+		if (!set_writable(false)) return nullptr;
+
+		return stub;
+	}
+
+	bool LazyJitCode::run(long& result){
+		long (*start)() = function<long (*)()>("_start");
+
+		if (start == nullptr){
+			fprintf(stderr, "undefined Theurgy _start\n");
+			return false;
+		}
+
+		result = start();
+		aristotle_flush();
+
+		return true;
+	}
+};
+
+extern "C" const void* aristotle_jit_compile(CodeGeneratorNS::Jit::LazyStub* stub){
+	return stub->jit->compile(stub->index);
+}
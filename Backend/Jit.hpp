@@ -0,0 +1,155 @@
+#pragma once
+#include "CodeGenerator.cpp"
+#include "../Lib/Runtime.hpp"
+#include <sys/mman.h>
+
+namespace CodeGeneratorNS {
+	namespace Jit {
+		//in-process definition of a symbol the generated code references,
+		//functions are reached through a stub, data is copied next to the code
+		struct Import {
+			const char* name;
+			const void* address;
+			size_t size; //0 for functions
+		};
+
+		constexpr size_t STUB_SIZE = 14; //jmp [rip + 0]; dq address
+
+		extern const Import RUNTIME[];
+		extern const size_t RUNTIME_SIZE;
+
+		const Import* find_import(const Import* imports, size_t num_imports, const char* name);
+		void write_stub(uint8_t* stub, const void* address);
+
+		// /tmp/perf-<pid>.map, where perf looks up the names of code it finds no ELF file for:
+		// one "start size name" line per Theurgy, in hex.
+		class PerfMap {
+		private:
+			FILE* map_f = nullptr;
+			bool is_failed = false;
+
+		public:
+			PerfMap() = default;
+			~PerfMap();
+
+			PerfMap(const PerfMap&) = delete;
+			PerfMap& operator=(const PerfMap&) = delete;
+
+			void add(const void* start, size_t size, const char* name);
+		};
+	};
+
+	// Generated code mapped into the process: written while the pages are RW, executed once they are RX,
+	// never both. The pages come from the low 2GB so that imm32 address loads still work.
+	class JitCode {
+	private:
+		CodeGenerator& gen;
+
+		uint8_t* pages = nullptr;
+		size_t pages_size = 0;
+		size_t code_size  = 0; //import slots follow the code
+
+		bool link(CodeBuffer& code, const Jit::Import* imports, size_t num_imports);
+
+	public:
+		JitCode(CodeGenerator& gen, const Jit::Import* imports = Jit::RUNTIME, size_t num_imports = Jit::RUNTIME_SIZE);
+		~JitCode();
+
+		JitCode(const JitCode&) = delete;
+		JitCode& operator=(const JitCode&) = delete;
+
+		bool is_ready();
+		void* address(const char* name);
+
+		//Theurgy as a C function, e.g. function<long (*)(long, long)>("gcd"),
+		//nullptr unless it exists and follows System V
+		template <typename Func>
+		Func function(const char* name){
+			return reinterpret_cast<Func>(address(name));
+		}
+
+		//calls _start, false if there is none
+		bool run(long& result);
+
+		//names every Theurgy in the map
+		void write_perf_map(Jit::PerfMap& map);
+	};
+
+	class LazyJitCode;
+
+	namespace Jit {
+		constexpr size_t ARENA_SIZE = 1 << 26; //address space reserved for stubs and code
+
+		//what a Theurgy is called through until it is compiled, then a jmp to its code
+		struct LazyStub {
+			uint8_t code[16]; //push imm32 &stub; jmp resolver
+			LazyJitCode* jit;
+			uint32_t index;   //of the Theurgy in jit
+			uint32_t padding;
+		};
+
+		static_assert(sizeof(LazyStub) == 32, "Stubs are meant to take 32 bytes");
+
+		struct LazyFunction {
+			const char* name;
+			LazyStub* stub;
+			uint8_t* code; //nullptr until the first call
+		};
+	};
+
+	// Every Theurgy starts as a stub, its first call generates and encodes just its DEC_FUNC subtree,
+	// links the code against what is already compiled and redirects the stub to it. Calls compiled
+	// later go straight to the code. The arena is reserved at once and is RX except while it is written.
+	class LazyJitCode {
+	private:
+		CodeGenerator& gen;
+
+		const Jit::Import* imports;
+		size_t num_imports;
+		Vector<uint8_t*> import_slots;
+
+		uint8_t* arena = nullptr;
+		size_t used = 0;
+
+		Vector<Jit::LazyFunction> functions;
+		size_t num_compiled = 0;
+
+		Jit::PerfMap* perf_map = nullptr;
+
+		uint8_t* allocate(size_t size);
+		bool set_writable(bool is_writable);
+
+		bool is_linkable();
+		size_t find_function(const char* name);
+		uint8_t* import_slot(const Jit::Import* import);
+		const void* link_target(const Assembly::Fixup& ref);
+
+	public:
+		LazyJitCode(CodeGenerator& gen, const Jit::Import* imports = Jit::RUNTIME, size_t num_imports = Jit::RUNTIME_SIZE);
+		~LazyJitCode();
+
+		LazyJitCode(const LazyJitCode&) = delete;
+		LazyJitCode& operator=(const LazyJitCode&) = delete;
+
+		bool is_ready();
+		void* address(const char* name);
+
+		template <typename Func>
+		Func function(const char* name){
+			return reinterpret_cast<Func>(address(name));
+		}
+
+		//calls _start, false if there is none
+		bool run(long& result);
+
+		//called by the stubs, returns where the Theurgy was placed
+		const void* compile(size_t index);
+
+		size_t compiled(){
+			return num_compiled;
+		}
+
+		//Theurgies compiled from then on are named in the map
+		void set_perf_map(Jit::PerfMap& map);
+	};
+};
@@ -0,0 +1,193 @@
+#pragma once
+#include "ObjectFile.hpp"
+
+namespace CodeGeneratorNS {
+	bool ObjectFile::load(const char* filename){
+		assert(filename != nullptr);
+
+		using namespace ELF::IntelExec86_64;
+
+		this->filename = filename;
+
+		FILE* input_f = fopen(filename, "rb");
+
+		if (input_f == nullptr){
+			fprintf(stderr, "cannot read %s, build it from Lib/Runtime.cpp\n", filename);
+			return false;
+		}
+
+		fseek(input_f, 0, SEEK_END);
+		long size = ftell(input_f);
+		fseek(input_f, 0, SEEK_SET);
+
+		bool is_read = size > 0 && fread(file.append(size), 1, size, input_f) == (size_t)size;
+		fclose(input_f);
+
+		const ELF::Header* header = reinterpret_cast<const ELF::Header*>(file.data());
+
+		if (!is_read || file.size() < sizeof(ELF::Header) || header->EI_MAG != ELF::MAG_NUM || header->EI_CLASS != CLASS ||
+		    header->E_TYPE != ET_REL || header->E_MACHINE != EM || header->E_SHENTSIZE != SHENTSIZE ||
+		    header->E_SHOFF + header->E_SHNUM * sizeof(ELF::SectionHeader) > file.size()){
+
+			fprintf(stderr, "%s is not an x86-64 relocatable object\n", filename);
+			return false;
+		}
+
+		sections     = reinterpret_cast<ELF::SectionHeader*>(file.data() + header->E_SHOFF);
+		num_sections = header->E_SHNUM;
+
+		offsets.resize(num_sections);
+
+		for (size_t i = 0; i < num_sections; ++i){
+			offsets[i] = Linking::NOT_PLACED;
+
+			if (sections[i].SH_TYPE != ELF::SecType::SHT_NOBITS && sections[i].SH_OFFSET + sections[i].SH_SIZE > file.size()){
+				fprintf(stderr, "%s is truncated\n", filename);
+				return false;
+			}
+
+			if (sections[i].SH_TYPE != ELF::SecType::SHT_SYMTAB) continue;
+
+			symtab      = reinterpret_cast<ELF::Symbol*>(file.data() + sections[i].SH_OFFSET);
+			num_symbols = sections[i].SH_SIZE / sizeof(ELF::Symbol);
+			strtab      = reinterpret_cast<const char*>(file.data() + sections[sections[i].SH_LINK].SH_OFFSET);
+		}
+
+		if (symtab == nullptr){
+			fprintf(stderr, "%s has no symbol table\n", filename);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool ObjectFile::is_placed(const ELF::SectionHeader& section, bool is_writable, bool is_nobits){
+		if (!(section.SH_FLAGS & ELF::SecFlags::SHF_ALLOC)) return false;
+
+		return ((section.SH_FLAGS & ELF::SecFlags::SHF_WRITE) != 0) == is_writable &&
+		       (section.SH_TYPE == ELF::SecType::SHT_NOBITS) == is_nobits;
+	}
+
+	void ObjectFile::place(CodeBuffer& image, bool is_writable){
+		for (size_t i = 0; i < num_sections; ++i){
+			if (!is_placed(sections[i], is_writable, false)) continue;
+
+			size_t alignment = (sections[i].SH_ADDRALIGN > 1)?(sections[i].SH_ADDRALIGN):(1);
+			size_t padding   = (alignment - image.size() % alignment) % alignment;
+
+			memset(image.append(padding), 0, padding);
+
+			offsets[i] = image.size();
+			memcpy(image.append(sections[i].SH_SIZE), file.data() + sections[i].SH_OFFSET, sections[i].SH_SIZE);
+		}
+	}
+
+	size_t ObjectFile::place_nobits(size_t offset){
+		for (size_t i = 0; i < num_sections; ++i){
+			if (!is_placed(sections[i], true, true)) continue;
+
+			size_t alignment = (sections[i].SH_ADDRALIGN > 1)?(sections[i].SH_ADDRALIGN):(1);
+
+			offsets[i] = (offset + alignment - 1) / alignment * alignment;
+			offset = offsets[i] + sections[i].SH_SIZE;
+		}
+
+		return offset;
+	}
+
+	bool ObjectFile::symbol_address(size_t index, uint64_t base, uint64_t& address){
+		if (index >= num_symbols) return false;
+
+		const ELF::Symbol& symbol = symtab[index];
+
+		if (symbol.ST_SHNDX == ELF::SHN_ABS){
+			address = symbol.ST_VALUE;
+			return true;
+		}
+
+		if (symbol.ST_SHNDX >= num_sections || offsets[symbol.ST_SHNDX] == Linking::NOT_PLACED) return false;
+
+		address = base + offsets[symbol.ST_SHNDX] + symbol.ST_VALUE;
+		return true;
+	}
+
+	bool ObjectFile::find(const char* name, uint64_t base, uint64_t& address){
+		assert(name != nullptr);
+
+		for (size_t i = 0; i < num_symbols; ++i){
+			uint8_t bind = symtab[i].ST_INFO >> 4;
+
+			if (bind != ELF::SymBind::STB_GLOBAL && bind != ELF::SymBind::STB_WEAK) continue;
+			if (symtab[i].ST_SHNDX == ELF::SHN_UNDEF || strcmp(strtab + symtab[i].ST_NAME, name) != 0) continue;
+
+			return symbol_address(i, base, address);
+		}
+
+		return false;
+	}
+
+	// Only what a static, non-PIC image needs: absolute and pc-relative fields, calls go straight
+	// to their target since nothing is left for a dynamic linker.
+	bool ObjectFile::relocate(CodeBuffer& image, uint64_t base){
+		for (size_t i = 0; i < num_sections; ++i){
+			if (sections[i].SH_TYPE != ELF::SecType::SHT_RELA) continue;
+
+			size_t target = sections[i].SH_INFO;
+			if (target >= num_sections || offsets[target] == Linking::NOT_PLACED) continue;
+
+			const ELF::Rela* relas = reinterpret_cast<const ELF::Rela*>(file.data() + sections[i].SH_OFFSET);
+			size_t num_relas = sections[i].SH_SIZE / sizeof(ELF::Rela);
+
+			for (size_t j = 0; j < num_relas; ++j){
+				size_t   symbol = relas[j].R_INFO >> 32;
+				uint32_t type   = relas[j].R_INFO & 0xFFFFFFFF;
+
+				uint64_t address = 0;
+
+				if (!symbol_address(symbol, base, address)){
+					fprintf(stderr, "undefined symbol %s in %s\n", strtab + symtab[symbol].ST_NAME, filename);
+					return false;
+				}
+
+				uint8_t* field = image.data() + offsets[target] + relas[j].R_OFFSET;
+				uint64_t place = base + offsets[target] + relas[j].R_OFFSET;
+
+				int64_t value = address + relas[j].R_ADDEND;
+				bool is_fit = true;
+
+				switch (type){
+					case ELF::RelType::R_X86_64_64:
+						memcpy(field, &value, 8);
+						continue;
+
+					case ELF::RelType::R_X86_64_PC32:
+					case ELF::RelType::R_X86_64_PLT32:
+						value -= place;
+						is_fit = INT32_MIN <= value && value <= INT32_MAX;
+						break;
+
+					case ELF::RelType::R_X86_64_32:
+						is_fit = 0 <= value && value <= UINT32_MAX;
+						break;
+
+					case ELF::RelType::R_X86_64_32S:
+						is_fit = INT32_MIN <= value && value <= INT32_MAX;
+						break;
+
+					default:
+						fprintf(stderr, "unsupported relocation type %u in %s\n", type, filename);
+						return false;
+				}
+
+				if (!is_fit){
+					fprintf(stderr, "relocation against %s is out of range in %s\n", strtab + symtab[symbol].ST_NAME, filename);
+					return false;
+				}
+
+				memcpy(field, &value, 4);
+			}
+		}
+
+		return true;
+	}
+};
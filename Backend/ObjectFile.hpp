@@ -0,0 +1,56 @@
+#pragma once
+#include "../Lib/CompLib.hpp"
+#include "../Lib/CodeBuffer.hpp"
+#include "../ELFResearch/ELFformat.hpp"
+
+namespace CodeGeneratorNS {
+	namespace Linking {
+		constexpr const char* RUNTIME_OBJ = "runtime.o"; //Lib/Runtime.cpp built as its header says
+
+		//what the runtime's destructor does at exit, called by the entry stub of executables instead
+		constexpr const char* EXIT_HOOKS[] = {"aristotle_flush", "aristotle_dump_counters"};
+		constexpr size_t NUM_EXIT_HOOKS = sizeof(EXIT_HOOKS) / sizeof(EXIT_HOOKS[0]);
+
+		constexpr int64_t NOT_PLACED = -1;
+	};
+
+	// Relocatable ELF object linked into an image by the compiler itself, enough for the freestanding
+	// runtime: allocated sections are appended to the image, .bss is placed after its end, and the
+	// object's own relocations are applied once every section has its address.
+	class ObjectFile {
+	private:
+		CodeBuffer file;
+		const char* filename = nullptr;
+
+		ELF::SectionHeader* sections = nullptr;
+		size_t num_sections = 0;
+
+		ELF::Symbol* symtab = nullptr;
+		size_t num_symbols = 0;
+		const char* strtab = nullptr;
+
+		Vector<int64_t> offsets; //of every section in the image, NOT_PLACED for the rest
+
+		bool is_placed(const ELF::SectionHeader& section, bool is_writable, bool is_nobits);
+		bool symbol_address(size_t index, uint64_t base, uint64_t& address);
+
+	public:
+		ObjectFile() = default;
+
+		ObjectFile(const ObjectFile&) = delete;
+		ObjectFile& operator=(const ObjectFile&) = delete;
+
+		bool load(const char* filename);
+
+		//sections with data, read-only or writable ones
+		void place(CodeBuffer& image, bool is_writable);
+
+		//.bss from offset on, returns where it ends
+		size_t place_nobits(size_t offset);
+
+		//of a global symbol once the image is loaded at base
+		bool find(const char* name, uint64_t base, uint64_t& address);
+
+		bool relocate(CodeBuffer& image, uint64_t base);
+	};
+};
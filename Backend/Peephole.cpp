@@ -0,0 +1,398 @@
+#pragma once
+#include "Peephole.hpp"
+
+namespace CodeGeneratorNS {
+	namespace Peephole {
+		using namespace Assembly;
+
+		Instruction& Code::operator[](size_t pos){
+			return ops[pos];
+		}
+
+		size_t Code::size(){
+			return ops.size();
+		}
+
+		void Code::resize(size_t new_size){
+			ops.resize(new_size);
+			lines.resize(new_size);
+		}
+
+		void Code::push_back(const Instruction& instruction, uint32_t line){
+			ops.push_back(instruction);
+			lines.push_back(line);
+		}
+
+		bool reads(const Instruction& ops, Registers::Reg reg){
+			switch (ops.op){
+				case Opcodes::MOV_RR:
+				case Opcodes::LOAD:
+				case Opcodes::IMUL_RI:
+					return ops.src == reg;
+
+				case Opcodes::LEA:
+					return ops.src == reg || ops.index == reg;
+
+				case Opcodes::STORE:
+				case Opcodes::ADD_RM:
+				case Opcodes::SUB_RM:
+				case Opcodes::IMUL_RM:
+				case Opcodes::CMP_RM:
+				case Opcodes::ADD_RR:
+				case Opcodes::SUB_RR:
+				case Opcodes::IMUL_RR:
+				case Opcodes::CMP_RR:
+					return ops.dst == reg || ops.src == reg;
+
+				case Opcodes::XOR_RR:
+					return ops.dst != ops.src && (ops.dst == reg || ops.src == reg);
+
+				case Opcodes::ADD_RI:
+				case Opcodes::SUB_RI:
+				case Opcodes::CMP_RI:
+					return ops.dst == reg;
+
+				case Opcodes::IDIV:
+					return ops.src == reg || reg == Registers::RAX || reg == Registers::RDX;
+
+				case Opcodes::CQO:
+					return reg == Registers::RAX;
+
+				case Opcodes::PUSH:
+					return ops.src == reg || reg == Registers::RSP;
+
+				case Opcodes::POP:
+				case Opcodes::PUSH_I:
+					return reg == Registers::RSP;
+
+				case Opcodes::MOV_RI:
+				case Opcodes::LOAD_LABEL:
+					return false;
+
+				default:
+					return true;
+			}
+		}
+
+		bool writes(const Instruction& ops, Registers::Reg reg){
+			switch (ops.op){
+				case Opcodes::MOV_RR:
+				case Opcodes::MOV_RI:
+				case Opcodes::LOAD:
+				case Opcodes::LOAD_LABEL:
+				case Opcodes::ADD_RR:
+				case Opcodes::ADD_RI:
+				case Opcodes::SUB_RR:
+				case Opcodes::SUB_RI:
+				case Opcodes::IMUL_RR:
+				case Opcodes::XOR_RR:
+				case Opcodes::ADD_RM:
+				case Opcodes::SUB_RM:
+				case Opcodes::IMUL_RM:
+				case Opcodes::IMUL_RI:
+				case Opcodes::LEA:
+					return ops.dst == reg;
+
+				case Opcodes::POP:
+					return ops.dst == reg || reg == Registers::RSP;
+
+				case Opcodes::PUSH:
+				case Opcodes::PUSH_I:
+					return reg == Registers::RSP;
+
+				case Opcodes::IDIV:
+					return reg == Registers::RAX || reg == Registers::RDX;
+
+				case Opcodes::CQO:
+					return reg == Registers::RDX;
+
+				case Opcodes::STORE:
+				case Opcodes::CMP_RR:
+				case Opcodes::CMP_RI:
+				case Opcodes::CMP_RM:
+					return false;
+
+				default:
+					return true;
+			}
+		}
+
+		bool is_barrier(Opcodes::Op code){
+			switch (code){
+				case Opcodes::NONE:
+				case Opcodes::CALL:
+				case Opcodes::JMP:
+				case Opcodes::JZ:
+				case Opcodes::JNZ:
+				case Opcodes::JG:
+				case Opcodes::JGE:
+				case Opcodes::JL:
+				case Opcodes::JLE:
+				case Opcodes::RET:
+				case Opcodes::SYSCALL:
+				case Opcodes::LABEL:
+					return true;
+
+				default:
+					return false;
+			}
+		}
+
+		bool is_conditional_jump(Opcodes::Op code){
+			return code == Opcodes::JZ || code == Opcodes::JNZ || code == Opcodes::JG ||
+			       code == Opcodes::JGE || code == Opcodes::JL || code == Opcodes::JLE;
+		}
+
+		bool is_dead_after(Code& code, size_t pos, Registers::Reg reg){
+			for (size_t i = pos + 1; i < code.size(); ++i){
+				Instruction ops = code[i];
+
+				if (is_barrier(ops.op)) break;
+				if (reads(ops, reg))    return false;
+				if (writes(ops, reg))   return true;
+			}
+
+			for (size_t i = 0; i < BLOCK_LOCAL_SIZE; ++i){
+				if (BLOCK_LOCAL[i] == reg) return true;
+			}
+
+			return false;
+		}
+
+		void erase(Code& code, size_t pos){
+			assert(pos < code.size());
+
+			for (size_t i = pos + 1; i < code.size(); ++i){
+				code[i - 1] = code[i];
+				code.lines[i - 1] = code.lines[i];
+			}
+
+			code.resize(code.size() - 1);
+		}
+
+		//the replacement stands for the same statement and keeps its line
+		void replace(Code& code, size_t pos, const Instruction& instruction){
+			assert(pos < code.size());
+
+			code[pos] = instruction;
+		}
+
+//===========================================================================//
+//                                  RULES
+//===========================================================================//
+
+		// mov r, r
+		bool is_self_move(Code& code, size_t pos){
+			Instruction ops = code[pos];
+
+			return ops.dst == ops.src;
+		}
+
+		// mov a, src; op ..., a  =>  op ..., src  when a dies there
+		bool is_forwardable(Code& code, size_t pos){
+			Instruction def = code[pos];
+			Instruction use = code[pos + 1];
+
+			if (!reads(use, def.dst) || !is_dead_after(code, pos + 1, def.dst)) return false;
+
+			if (def.op != Opcodes::MOV_RR){
+				return use.op == Opcodes::MOV_RR && use.dst != def.dst && use.dst != def.src;
+			}
+
+			if (def.src == Registers::RSP) return false;
+
+			switch (use.op){
+				case Opcodes::MOV_RR:
+				case Opcodes::STORE:
+				case Opcodes::PUSH:
+				case Opcodes::CMP_RR:
+				case Opcodes::CMP_RI:
+				case Opcodes::CMP_RM:
+					return true;
+
+				default:
+					return use.dst != def.dst;
+			}
+		}
+
+		void forward_copy(Code& code, size_t pos){
+			Instruction def = code[pos];
+			Instruction use = code[pos + 1];
+
+			if (def.op != Opcodes::MOV_RR){
+				def.dst = use.dst;
+				replace(code, pos + 1, def);
+			}
+
+			else {
+				if (use.dst == def.dst) use.dst = def.src;
+				if (use.src == def.dst) use.src = def.src;
+
+				replace(code, pos + 1, use);
+			}
+
+			erase(code, pos);
+		}
+
+		// mov a, b; mov b, a  =>  mov a, b
+		bool is_copy_back(Code& code, size_t pos){
+			Instruction first  = code[pos];
+			Instruction second = code[pos + 1];
+
+			return first.dst == second.src && first.src == second.dst;
+		}
+
+		void erase_next(Code& code, size_t pos){
+			erase(code, pos + 1);
+		}
+
+		// a value nobody reads before it is overwritten
+		bool is_dead_def(Code& code, size_t pos){
+			return is_dead_after(code, pos, code[pos].dst);
+		}
+
+		void erase_one(Code& code, size_t pos){
+			erase(code, pos);
+		}
+
+		size_t find_pop(Code& code, size_t pos){
+			Registers::Reg src = code[pos].src;
+			size_t depth = 0;
+
+			for (size_t i = pos + 1; i < code.size() && i <= pos + WINDOW; ++i){
+				Instruction ops = code[i];
+
+				if (is_barrier(ops.op)) return 0;
+
+				if (ops.op == Opcodes::PUSH) ++depth;
+
+				else if (ops.op == Opcodes::POP){
+					if (depth == 0) return (ops.dst == Registers::RSP || src == Registers::RSP)?(0):(i);
+					--depth;
+				}
+
+				else if (reads(ops, Registers::RSP) || writes(ops, Registers::RSP)) return 0;
+			}
+
+			return 0;
+		}
+
+		// push a ... pop b  =>  mov b, a ...  when b is untouched in between
+		bool is_pushed_copy(Code& code, size_t pos){
+			size_t pop = find_pop(code, pos);
+			if (pop == 0) return false;
+
+			Registers::Reg dst = code[pop].dst;
+
+			for (size_t i = pos + 1; i < pop; ++i){
+				Instruction ops = code[i];
+				if (reads(ops, dst) || writes(ops, dst)) return false;
+			}
+
+			return true;
+		}
+
+		void pushed_copy(Code& code, size_t pos){
+			size_t pop = find_pop(code, pos);
+
+			Registers::Reg dst = code[pop].dst;
+			Registers::Reg src = code[pos].src;
+
+			erase(code, pop);
+
+			if (dst == src) erase(code, pos);
+			else            replace(code, pos, MovReg2Reg(dst, src));
+		}
+
+		// jmp to a label that follows right away
+		bool jumps_to_next(Code& code, size_t pos){
+			Instruction jmp = code[pos];
+
+			for (size_t i = pos + 1; i < code.size(); ++i){
+				Instruction ops = code[i];
+				if (ops.op != Opcodes::LABEL) return false;
+
+				if (jmp.label == ops.label) return true;
+			}
+
+			return false;
+		}
+
+		// mov r, 0  =>  xor r, r  unless flags are about to be read
+		bool is_zero_load(Code& code, size_t pos){
+			if (code[pos].imm != 0) return false;
+
+			return pos + 1 == code.size() || !is_conditional_jump(code[pos + 1].op);
+		}
+
+		void zero_idiom(Code& code, size_t pos){
+			Registers::Reg dst = code[pos].dst;
+
+			replace(code, pos, XorReg2Reg(dst, dst));
+		}
+
+		const Rule RULES[] = {
+			{"self move",    {op(Opcodes::MOV_RR)}, is_self_move, erase_one},
+
+			{"copy forward", {op(Opcodes::MOV_RR) | op(Opcodes::MOV_RI) | op(Opcodes::LOAD),
+			                  op(Opcodes::MOV_RR) | op(Opcodes::STORE)  | op(Opcodes::PUSH)   |
+			                  op(Opcodes::ADD_RR) | op(Opcodes::SUB_RR) | op(Opcodes::IMUL_RR) |
+			                  op(Opcodes::XOR_RR) | op(Opcodes::CMP_RR) | op(Opcodes::CMP_RI) | op(Opcodes::CMP_RM)},
+			                  is_forwardable, forward_copy},
+
+			{"copy back",    {op(Opcodes::MOV_RR), op(Opcodes::MOV_RR)}, is_copy_back, erase_next},
+
+			{"dead def",     {op(Opcodes::MOV_RR) | op(Opcodes::MOV_RI) | op(Opcodes::LOAD) | op(Opcodes::LOAD_LABEL)},
+			                  is_dead_def, erase_one},
+
+			{"push pop",     {op(Opcodes::PUSH)}, is_pushed_copy, pushed_copy},
+			{"jump to next", {op(Opcodes::JMP)},  jumps_to_next,  erase_one},
+			{"zero idiom",   {op(Opcodes::MOV_RI)}, is_zero_load, zero_idiom},
+		};
+
+		constexpr size_t NUM_RULES = sizeof(RULES) / sizeof(RULES[0]);
+		static_assert(NUM_RULES <= MAX_RULES, "Too many peephole rules");
+	};
+
+	PeepholeOptimizer::PeepholeOptimizer(Peephole::Code& code): code(code) {}
+
+	bool PeepholeOptimizer::matches(const Peephole::Rule& rule, size_t pos){
+		for (size_t i = 0; i < Peephole::MAX_PATTERN && rule.pattern[i] != 0; ++i){
+			if (pos + i >= code.size()) return false;
+			if ((rule.pattern[i] & Peephole::op(code[pos + i].op)) == 0) return false;
+		}
+
+		return rule.applies(code, pos);
+	}
+
+	// Rules are tried in table order at every position until none fires,
+	// a rewrite steps back so that it can complete a pattern it ends.
+	void PeepholeOptimizer::run(){
+		size_t pos = 0;
+
+		while (pos < code.size()){
+			bool is_fired = false;
+
+			for (size_t i = 0; i < Peephole::NUM_RULES; ++i){
+				if (!matches(Peephole::RULES[i], pos)) continue;
+
+				Peephole::RULES[i].rewrite(code, pos);
+				++fired[i];
+
+				is_fired = true;
+				break;
+			}
+
+			if (!is_fired)    ++pos;
+			else if (pos > 0) --pos;
+		}
+	}
+
+	void PeepholeOptimizer::dump_stats(FILE* output_f){
+		assert(output_f != nullptr);
+
+		for (size_t i = 0; i < Peephole::NUM_RULES; ++i){
+			fprintf(output_f, "peephole %-13s %zu\n", Peephole::RULES[i].name, fired[i]);
+		}
+	}
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include "../Lib/CompLib.hpp"
+
+namespace CodeGeneratorNS {
+	namespace Peephole {
+		//instructions and the source line of each in a parallel array, 0 if unknown
+		struct Code {
+			Vector<Assembly::Instruction> ops;
+			Vector<uint32_t> lines;
+
+			Assembly::Instruction& operator[](size_t pos);
+			size_t size();
+			void resize(size_t new_size);
+			void push_back(const Assembly::Instruction& instruction, uint32_t line = 0);
+		};
+
+		constexpr size_t MAX_PATTERN = 2;
+		constexpr size_t MAX_RULES   = 16;
+		constexpr size_t WINDOW      = 16; //how far apart a push and its pop may be
+
+		//expression temporaries, the code generator never keeps them across labels, jumps and calls
+		constexpr Assembly::Registers::Reg BLOCK_LOCAL[] = {
+			Assembly::Registers::R10,
+			Assembly::Registers::R11,
+		};
+
+		constexpr size_t BLOCK_LOCAL_SIZE = sizeof(BLOCK_LOCAL) / sizeof(BLOCK_LOCAL[0]);
+
+		constexpr uint64_t op(Assembly::Opcodes::Op code){
+			return 1ull << code;
+		}
+
+		//pattern is a sequence of opcode sets, terminated by 0
+		struct Rule {
+			const char* name;
+			uint64_t pattern[MAX_PATTERN];
+			bool (*applies)(Code& code, size_t pos);
+			void (*rewrite)(Code& code, size_t pos);
+		};
+
+		bool reads (const Assembly::Instruction& ops, Assembly::Registers::Reg reg);
+		bool writes(const Assembly::Instruction& ops, Assembly::Registers::Reg reg);
+		bool is_barrier(Assembly::Opcodes::Op code);
+		bool is_conditional_jump(Assembly::Opcodes::Op code);
+		bool is_dead_after(Code& code, size_t pos, Assembly::Registers::Reg reg);
+
+		void erase(Code& code, size_t pos);
+		void replace(Code& code, size_t pos, const Assembly::Instruction& instruction);
+	};
+
+	class PeepholeOptimizer {
+	private:
+		Peephole::Code& code;
+		size_t fired[Peephole::MAX_RULES] = {};
+
+		bool matches(const Peephole::Rule& rule, size_t pos);
+
+	public:
+		explicit PeepholeOptimizer(Peephole::Code& code);
+
+		void run();
+		void dump_stats(FILE* output_f);
+	};
+};
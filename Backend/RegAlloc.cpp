@@ -0,0 +1,277 @@
+#pragma once
+#include "RegAlloc.hpp"
+
+namespace CodeGeneratorNS {
+	RegisterAllocator::RegisterAllocator(ASTreeNS::ASTNode_t* func){
+		assert(func != nullptr);
+		assert(func->key.code == Operator::DEC_FUNC);
+
+		name_ = func->right()->key.lexem;
+
+		number_args(func->left(), num_args_);
+
+		cur_point = 1;
+		number_block(func->right()->right());
+	}
+
+	const char* RegisterAllocator::name() const {
+		return name_;
+	}
+
+	size_t RegisterAllocator::num_intervals(){
+		return intervals.size();
+	}
+
+	LiveInterval& RegisterAllocator::operator[](size_t index){
+		return intervals[index];
+	}
+
+	size_t RegisterAllocator::num_args() const {
+		return num_args_;
+	}
+
+	size_t RegisterAllocator::num_calls(){
+		return calls.size();
+	}
+
+	CallSite& RegisterAllocator::call(size_t index){
+		return calls[index];
+	}
+
+	void RegisterAllocator::set_min_uses(size_t uses){
+		min_uses = uses;
+	}
+
+	size_t RegisterAllocator::num_spill_slots() const {
+		return num_spill_slots_;
+	}
+
+	bool RegisterAllocator::is_used(size_t pool_index) const {
+		assert(pool_index < Allocation::POOL_SIZE);
+
+		return used_regs[pool_index];
+	}
+
+	// A register is clobbered if the Theurgy allocates it or any of its callees does not preserve it.
+	bool RegisterAllocator::is_clobbered(size_t pool_index){
+		assert(pool_index < Allocation::POOL_SIZE);
+
+		if (used_regs[pool_index]) return true;
+
+		for (size_t i = 0; i < calls.size(); ++i){
+			if (calls[i].clobbers[pool_index]) return true;
+		}
+
+		return false;
+	}
+
+	LiveInterval* RegisterAllocator::find(const char* var){
+		for (size_t i = 0; i < intervals.size(); ++i){
+			if (strcmp(intervals[i].var, var) == 0) return &intervals[i];
+		}
+
+		return nullptr;
+	}
+
+	void RegisterAllocator::touch(const char* var){
+		LiveInterval* interval = find(var);
+
+		if (interval == nullptr){
+			LiveInterval new_interval = {};
+			new_interval.var   = var;
+			new_interval.start = cur_point;
+			new_interval.end   = cur_point;
+			new_interval.uses  = 1;
+
+			intervals.push_back(new_interval);
+			return;
+		}
+
+		interval->end = cur_point;
+		++interval->uses;
+	}
+
+	void RegisterAllocator::number_args(ASTreeNS::ASTNode_t* node, size_t& num_args){
+		assert(node != nullptr);
+		assert(node->key.code == Operator::COMMA);
+
+		if (node->right() == nullptr) return;
+
+		++num_args;
+		touch(node->right()->key.lexem);
+
+		LiveInterval* arg = find(node->right()->key.lexem);
+		arg->is_arg = true;
+
+		if (num_args <= Allocation::ARGUMENTS_SIZE){
+			arg->arg_reg = Allocation::ARGUMENTS[num_args - 1];
+		}
+
+		else {
+			arg->loc.offset = (num_args - Allocation::ARGUMENTS_SIZE + 1) * 8;
+		}
+
+		if (node->left() != nullptr) number_args(node->left(), num_args);
+	}
+
+	void RegisterAllocator::number_block(ASTreeNS::ASTNode_t* block){
+		for (; block != nullptr && block->right() != nullptr; block = block->left()){
+			ASTreeNS::ASTNode_t* stmt = block->right();
+
+			if (stmt->key.code == Operator::IF){
+				number_uses(stmt->left());
+				++cur_point;
+
+				number_block(stmt->right()->right());
+				number_block(stmt->right()->left());
+				continue;
+			}
+
+			if (stmt->key.code == Operator::DEC_VAR) continue;
+
+			ASTreeNS::ASTNode_t* call = (stmt->key.code == Operator::ASSGN)?(stmt->right()):(stmt);
+
+			if (call->key.code == Operator::CALL){
+				CallSite site = {};
+				site.callee = call->right()->key.lexem;
+				site.point  = cur_point;
+
+				calls.push_back(site);
+			}
+
+			number_uses(stmt);
+			++cur_point;
+		}
+	}
+
+	void RegisterAllocator::number_uses(ASTreeNS::ASTNode_t* node){
+		if (node == nullptr) return;
+
+		if (node->key.type == TokenizerNS::ID &&
+		    !(node->parent()->key.code == Operator::CALL && node->is_right())){
+			touch(node->key.lexem);
+		}
+
+		number_uses(node->left());
+		number_uses(node->right());
+	}
+
+	void RegisterAllocator::spill(LiveInterval* interval){
+		assert(interval != nullptr);
+
+		interval->loc.reg = Assembly::Registers::NOT_REG;
+
+		if (interval->is_arg && interval->arg_reg == Assembly::Registers::NOT_REG) return;
+		if (interval->is_arg && interval->uses == 1) return;
+
+		++num_spill_slots_;
+		interval->loc.offset = num_spill_slots_ * (-8);
+	}
+
+	// Values living across a call must avoid the registers the callee clobbers,
+	// the ones consumed or produced by the call itself are free to use them.
+	bool RegisterAllocator::crosses_clobber(LiveInterval* interval, size_t pool_index){
+		for (size_t i = 0; i < calls.size(); ++i){
+			if (calls[i].clobbers[pool_index] && interval->start < calls[i].point && calls[i].point < interval->end){
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	bool RegisterAllocator::is_free_for(LiveInterval* interval, size_t pool_index, bool* free_regs){
+		return free_regs[pool_index] && !crosses_clobber(interval, pool_index);
+	}
+
+	void RegisterAllocator::allocate(){
+		size_t num = intervals.size();
+
+		LiveInterval** sorted = new LiveInterval*[num + 1]();
+		LiveInterval** active = new LiveInterval*[Allocation::POOL_SIZE]();
+		size_t num_active = 0;
+
+		for (size_t i = 0; i < num; ++i){
+			size_t pos = i;
+
+			while (pos > 0 && sorted[pos - 1]->start > intervals[i].start){
+				sorted[pos] = sorted[pos - 1];
+				--pos;
+			}
+
+			sorted[pos] = &intervals[i];
+		}
+
+		bool free_regs[Allocation::POOL_SIZE] = {};
+		for (size_t i = 0; i < Allocation::POOL_SIZE; ++i) free_regs[i] = true;
+
+		for (size_t i = 0; i < num; ++i){
+			LiveInterval* cur = sorted[i];
+
+			if (cur->uses < min_uses){
+				spill(cur);
+				continue;
+			}
+
+			for (size_t j = 0; j < num_active; ){
+				if (active[j]->end < cur->start){
+					for (size_t r = 0; r < Allocation::POOL_SIZE; ++r){
+						if (Allocation::POOL[r] == active[j]->loc.reg) free_regs[r] = true;
+					}
+
+					active[j] = active[--num_active];
+				}
+
+				else ++j;
+			}
+
+			if (num_active == Allocation::POOL_SIZE){
+				size_t furthest = 0;
+
+				for (size_t j = 1; j < num_active; ++j){
+					if (active[j]->end > active[furthest]->end) furthest = j;
+				}
+
+				size_t furthest_reg = 0;
+				while (Allocation::POOL[furthest_reg] != active[furthest]->loc.reg) ++furthest_reg;
+
+				if (active[furthest]->end > cur->end && !crosses_clobber(cur, furthest_reg)){
+					cur->loc.reg = active[furthest]->loc.reg;
+					spill(active[furthest]);
+					active[furthest] = cur;
+				}
+
+				else {
+					spill(cur);
+				}
+
+				continue;
+			}
+
+			//registers that are already clobbered cost nothing more to take
+			size_t chosen = Allocation::POOL_SIZE;
+
+			for (size_t r = 0; r < Allocation::POOL_SIZE && chosen == Allocation::POOL_SIZE; ++r){
+				if (is_free_for(cur, r, free_regs) && is_clobbered(r)) chosen = r;
+			}
+
+			for (size_t r = 0; r < Allocation::POOL_SIZE && chosen == Allocation::POOL_SIZE; ++r){
+				if (is_free_for(cur, r, free_regs)) chosen = r;
+			}
+
+			if (chosen == Allocation::POOL_SIZE){
+				spill(cur);
+				continue;
+			}
+
+			free_regs[chosen] = false;
+			used_regs[chosen] = true;
+			cur->loc.reg = Allocation::POOL[chosen];
+
+			active[num_active++] = cur;
+		}
+
+		delete [] sorted;
+		delete [] active;
+	}
+};
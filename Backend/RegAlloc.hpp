@@ -0,0 +1,108 @@
+#pragma once
+#include "../Lib/CompLib.hpp"
+#include "../Frontend/ASTree.cpp"
+
+namespace CodeGeneratorNS {
+	namespace Allocation {
+		constexpr Assembly::Registers::Reg POOL[] = {
+			Assembly::Registers::RBX,
+			Assembly::Registers::R12,
+			Assembly::Registers::R13,
+			Assembly::Registers::R14,
+			Assembly::Registers::R15,
+		};
+
+		constexpr size_t POOL_SIZE = sizeof(POOL) / sizeof(POOL[0]);
+		constexpr size_t MIN_USES  = 3; //cheaper to keep rarer Ideas in the frame than to save a register
+		constexpr size_t MIN_USES_INTERNAL = 2; //internal Theurgies do not save what they clobber
+
+		//expression temporaries, RAX and RDX are left for idiv
+		constexpr Assembly::Registers::Reg SCRATCH[] = {
+			Assembly::Registers::R10,
+			Assembly::Registers::R11,
+			Assembly::Registers::RCX,
+			Assembly::Registers::RSI,
+			Assembly::Registers::RDI,
+			Assembly::Registers::R8,
+			Assembly::Registers::R9,
+		};
+
+		constexpr size_t SCRATCH_SIZE = sizeof(SCRATCH) / sizeof(SCRATCH[0]);
+
+		//System V AMD64: the rest of the arguments are pushed right to left
+		constexpr Assembly::Registers::Reg ARGUMENTS[] = {
+			Assembly::Registers::RDI,
+			Assembly::Registers::RSI,
+			Assembly::Registers::RDX,
+			Assembly::Registers::RCX,
+			Assembly::Registers::R8,
+			Assembly::Registers::R9,
+		};
+
+		constexpr size_t ARGUMENTS_SIZE = sizeof(ARGUMENTS) / sizeof(ARGUMENTS[0]);
+	};
+
+	struct Location {
+		Assembly::Registers::Reg reg = Assembly::Registers::NOT_REG;
+		int32_t offset = 0;
+	};
+
+	struct LiveInterval {
+		const char* var = nullptr;
+		size_t start = 0;
+		size_t end   = 0;
+		size_t uses  = 0;
+
+		bool is_arg = false;
+		Assembly::Registers::Reg arg_reg = Assembly::Registers::NOT_REG;
+		Location loc = {};
+	};
+
+	struct CallSite {
+		const char* callee = nullptr;
+		size_t point = 0;
+		bool clobbers[Allocation::POOL_SIZE] = {};
+	};
+
+	class RegisterAllocator {
+	private:
+		const char* name_ = nullptr;
+		Vector<LiveInterval> intervals;
+		Vector<CallSite> calls;
+		size_t cur_point = 0;
+		size_t num_args_ = 0;
+		size_t min_uses  = Allocation::MIN_USES;
+
+		size_t num_spill_slots_ = 0;
+		bool used_regs[Allocation::POOL_SIZE] = {};
+
+		LiveInterval* find(const char* var);
+		void touch(const char* var);
+
+		void number_args(ASTreeNS::ASTNode_t* node, size_t& num_args);
+		void number_block(ASTreeNS::ASTNode_t* block);
+		void number_uses(ASTreeNS::ASTNode_t* node);
+
+		void spill(LiveInterval* interval);
+		bool crosses_clobber(LiveInterval* interval, size_t pool_index);
+		bool is_free_for(LiveInterval* interval, size_t pool_index, bool* free_regs);
+
+	public:
+		explicit RegisterAllocator(ASTreeNS::ASTNode_t* func);
+
+		void allocate();
+		const char* name() const;
+
+		size_t num_intervals();
+		LiveInterval& operator[](size_t index);
+		size_t num_args() const;
+
+		size_t num_calls();
+		CallSite& call(size_t index);
+		void set_min_uses(size_t uses);
+
+		size_t num_spill_slots() const;
+		bool is_used(size_t pool_index) const;
+		bool is_clobbered(size_t pool_index);
+	};
+};
@@ -1,8 +1,9 @@
+#pragma once
 #include <cstdint>
 
 namespace ELF {
 
-	const uint32_t MAG_NUM  = 0x7F454C46; 
+	const uint32_t MAG_NUM  = 0x464C457F; //"\x7FELF" read as a little-endian word
 
 	namespace IntelExec86_64 {
 
@@ -11,6 +12,7 @@ namespace ELF {
 		const uint8_t  EV_CURENT = 0x01;
 		const uint8_t  SYSV_ABI  = 0x00;
 	
+		const uint16_t ET_REL    = 0x0001;
 		const uint16_t ET_EXEC   = 0x0002;
 		const uint16_t EM        = 0x003E;
 	
@@ -18,6 +20,9 @@ namespace ELF {
 		const uint16_t PHENTSIZE = 0x0038;
 		const uint16_t SHENTSIZE = 0x0040;
 
+		const uint64_t LOAD_ADDR = 0x400000; //where ld puts static executables
+		const uint64_t PAGE_SIZE = 0x1000;
+
 	}
 
  // ============================================================================
@@ -32,6 +37,7 @@ namespace ELF {
 		uint8_t  EI_VERSION;
 		uint8_t  EI_OSABI;    //Unix system V ABI
 		uint8_t  EI_OSABIVER; 
+		uint8_t  EI_PAD[7];   //e_ident is 16 bytes
 	
 		uint16_t E_TYPE;      //ET_EXEC - executable
 		uint16_t E_MACHINE;   //EM86_64
@@ -50,21 +56,23 @@ namespace ELF {
 		uint16_t E_SHSTRNDX;  //section header string index -- index of the .shstrtab section.
 	};
 
+	static_assert(sizeof(Header) == IntelExec86_64::EHSIZE, "ELF header is 64 bytes");
+
  // ============================================================================
  // Program Header Table 
  // Contains information of how the executable should be put into the process virtual memory.
  // ============================================================================
  
 	namespace SegType {
-		uint32_t PT_NULL = 0x0000;
-		uint32_t PT_LOAD = 0x0001;
-		uint32_t PT_DYNAMIC = 0x0002;
+		const uint32_t PT_NULL = 0x0000;
+		const uint32_t PT_LOAD = 0x0001;
+		const uint32_t PT_DYNAMIC = 0x0002;
 	};
 
 	namespace ProgFlags {
-		uint32_t PF_X = 0x1; //use;
-		uint32_t PF_W = 0x2; //write;
-		uint32_t PF_R = 0x4; //read;
+		const uint32_t PF_X = 0x1; //use;
+		const uint32_t PF_W = 0x2; //write;
+		const uint32_t PF_R = 0x4; //read;
 	}
  
 	struct ProgramHeader {
@@ -78,4 +86,121 @@ namespace ELF {
 		uint64_t P_ALLIGN; //usually 0x1000
 
 	};
+
+	static_assert(sizeof(ProgramHeader) == IntelExec86_64::PHENTSIZE, "Program header is 56 bytes");
+ // ============================================================================
+ // Section Header Table
+ // Only relocatable files need it: the linker reads code, symbols and relocations from sections.
+ // ============================================================================
+
+	namespace SecType {
+		const uint32_t SHT_NULL     = 0x0;
+		const uint32_t SHT_PROGBITS = 0x1;
+		const uint32_t SHT_SYMTAB   = 0x2;
+		const uint32_t SHT_STRTAB   = 0x3;
+		const uint32_t SHT_RELA     = 0x4;
+		const uint32_t SHT_NOBITS   = 0x8; //.bss: takes memory but no bytes in the file
+	};
+
+	namespace SecFlags {
+		const uint64_t SHF_WRITE     = 0x1;
+		const uint64_t SHF_ALLOC     = 0x2;
+		const uint64_t SHF_EXECINSTR = 0x4;
+		const uint64_t SHF_INFO_LINK = 0x40;
+	};
+
+	struct SectionHeader {
+		uint32_t SH_NAME;      //offset in .shstrtab
+		uint32_t SH_TYPE;
+		uint64_t SH_FLAGS;
+		uint64_t SH_ADDR;      //0 in relocatable files
+		uint64_t SH_OFFSET;    //of the contents in the file
+		uint64_t SH_SIZE;
+		uint32_t SH_LINK;      //symtab: its strtab, rela: its symtab
+		uint32_t SH_INFO;      //symtab: first global symbol, rela: section it patches
+		uint64_t SH_ADDRALIGN;
+		uint64_t SH_ENTSIZE;   //of table entries
+	};
+
+	static_assert(sizeof(SectionHeader) == IntelExec86_64::SHENTSIZE, "Section header is 64 bytes");
+
+ // ============================================================================
+ // Symbols and relocations
+ // ============================================================================
+
+	namespace SymBind {
+		const uint8_t STB_LOCAL  = 0x0;
+		const uint8_t STB_GLOBAL = 0x1;
+		const uint8_t STB_WEAK   = 0x2;
+	};
+
+	namespace SymType {
+		const uint8_t STT_NOTYPE  = 0x0;
+		const uint8_t STT_FUNC    = 0x2;
+		const uint8_t STT_SECTION = 0x3;
+	};
+
+	const uint16_t SHN_UNDEF = 0x0;
+	const uint16_t SHN_ABS   = 0xFFF1; //the value is an address, not an offset in a section
+
+	struct Symbol {
+		uint32_t ST_NAME;  //offset in .strtab
+		uint8_t  ST_INFO;  //bind << 4 | type
+		uint8_t  ST_OTHER;
+		uint16_t ST_SHNDX; //section the symbol is defined in, SHN_UNDEF for externals
+		uint64_t ST_VALUE; //offset in that section
+		uint64_t ST_SIZE;
+	};
+
+	static_assert(sizeof(Symbol) == 24, "Symbol is 24 bytes");
+
+	namespace RelType {
+		const uint32_t R_X86_64_64    = 1;
+		const uint32_t R_X86_64_PC32  = 2;
+		const uint32_t R_X86_64_PLT32 = 4;
+		const uint32_t R_X86_64_32    = 10;
+		const uint32_t R_X86_64_32S   = 11;
+	};
+
+	struct Rela {
+		uint64_t R_OFFSET; //of the patched field in the section
+		uint64_t R_INFO;   //symbol index << 32 | type
+		int64_t  R_ADDEND;
+	};
+
+	static_assert(sizeof(Rela) == 24, "Rela is 24 bytes");
+
+ // ============================================================================
+ // DWARF 4, just enough for a compilation unit and its line table
+ // ============================================================================
+
+	namespace DWARF {
+		const uint16_t VERSION = 4;
+
+		const uint8_t DW_TAG_compile_unit = 0x11;
+		const uint8_t DW_CHILDREN_no      = 0x00;
+
+		const uint8_t DW_AT_name      = 0x03;
+		const uint8_t DW_AT_stmt_list = 0x10;
+		const uint8_t DW_AT_low_pc    = 0x11;
+		const uint8_t DW_AT_high_pc   = 0x12;
+		const uint8_t DW_AT_comp_dir  = 0x1B;
+		const uint8_t DW_AT_producer  = 0x25;
+
+		const uint8_t DW_FORM_addr       = 0x01;
+		const uint8_t DW_FORM_data8      = 0x07;
+		const uint8_t DW_FORM_string     = 0x08;
+		const uint8_t DW_FORM_sec_offset = 0x17;
+
+		const uint8_t DW_LNS_copy         = 0x01;
+		const uint8_t DW_LNS_advance_pc   = 0x02;
+		const uint8_t DW_LNS_advance_line = 0x03;
+		const uint8_t OPCODE_BASE         = 13; //first special opcode
+
+		const uint8_t DW_LNE_end_sequence = 0x01;
+		const uint8_t DW_LNE_set_address  = 0x02;
+
+		const int8_t  LINE_BASE  = -5;
+		const uint8_t LINE_RANGE = 14;
+	}
 }
@@ -150,7 +150,8 @@ namespace ASTreeNS {
 
 	ASTNode_t* ASTree::parse_if(){
 			assert(cur_token->code == Operator::IF);
-			++cur_token;
+			uint32_t line = cur_token->line;
+			uint32_t site = (cur_token++)->site;
 
 			ASTNode_t* cond = parse_expression();
 			ASTNode_t* main_body = parse_block();
@@ -159,7 +160,7 @@ namespace ASTreeNS {
 			ASTNode_t* connection = new ASTNode_t(SPEC_CONNECTION, else_body, main_body);
 
 
-			return new ASTNode_t(TokenizerNS::Token("IF", TokenizerNS::OP, Operator::IF), cond, connection);
+			return new ASTNode_t(TokenizerNS::Token("IF", TokenizerNS::OP, Operator::IF, line, site), cond, connection);
 	}
 
 	ASTNode_t* ASTree::parse_while(){
@@ -168,16 +169,17 @@ namespace ASTreeNS {
 
 	ASTNode_t* ASTree::parse_var_decl(){
 		assert(cur_token->code == Operator::DEC_VAR);
-		++cur_token;
+		uint32_t line = (cur_token++)->line;
 
 		ASTNode_t* var = parse_id();
 
-		return new ASTNode_t(TokenizerNS::Token("DEC_VAR", TokenizerNS::SPEC, Operator::DEC_VAR), nullptr, var);
+		return new ASTNode_t(TokenizerNS::Token("DEC_VAR", TokenizerNS::SPEC, Operator::DEC_VAR, line), nullptr, var);
 	}
 
 	ASTNode_t* ASTree::parse_func_decl(){
 		assert(cur_token->code == Operator::DEC_FUNC);
-		++cur_token;
+		uint32_t line = cur_token->line;
+		uint32_t site = (cur_token++)->site;
 
 		ASTNode_t* name = parse_id();
 		ASTNode_t* args = parse_varlist();
@@ -185,12 +187,12 @@ namespace ASTreeNS {
 
 		name->attach_right(body);
 
-		return new ASTNode_t(TokenizerNS::Token("DEF_FUNC", TokenizerNS::SPEC, Operator::DEC_FUNC), args, name);
+		return new ASTNode_t(TokenizerNS::Token("DEF_FUNC", TokenizerNS::SPEC, Operator::DEC_FUNC, line, site), args, name);
 	}
 
 	ASTNode_t* ASTree::parse_var_init(){
 		assert(cur_token->code == Operator::ASSGN);
-		++cur_token;
+		uint32_t line = (cur_token++)->line;
 
 		ASTNode_t* var = parse_id();
 		ASTNode_t* val = nullptr;
@@ -203,60 +205,61 @@ namespace ASTreeNS {
 			val = parse_expression();
 		}
 
-		return new ASTNode_t(TokenizerNS::Token("=", TokenizerNS::SPEC, Operator::ASSGN), var, val);
+		return new ASTNode_t(TokenizerNS::Token("=", TokenizerNS::SPEC, Operator::ASSGN, line), var, val);
 	}
 
 	ASTNode_t* ASTree::parse_func_call(){
 		assert(cur_token->code == Operator::CALL);
-		++cur_token;
+		uint32_t line = cur_token->line;
+		uint32_t site = (cur_token++)->site;
 
 		ASTNode_t* name = parse_id();
 		ASTNode_t* args = parse_varlist();
 
-		return new ASTNode_t(TokenizerNS::Token("CALL", TokenizerNS::OP, Operator::CALL), args, name);
+		return new ASTNode_t(TokenizerNS::Token("CALL", TokenizerNS::OP, Operator::CALL, line, site), args, name);
 	}
 
 	ASTNode_t* ASTree::parse_return(){
 		assert(cur_token->code == Operator::RETURN);
-		++cur_token;
+		uint32_t line = (cur_token++)->line;
 
 		ASTNode_t* val = parse_expression();
 
-		return new ASTNode_t(TokenizerNS::Token("RET", TokenizerNS::OP, Operator::RETURN), nullptr, val);
+		return new ASTNode_t(TokenizerNS::Token("RET", TokenizerNS::OP, Operator::RETURN, line), nullptr, val);
 	}
 
 	ASTNode_t* ASTree::parse_print(){
 		assert(cur_token->code == Operator::WRITE);
-		++cur_token;
+		uint32_t line = (cur_token++)->line;
 
 		ASTNode_t* val = parse_expression();
 
-		return new ASTNode_t(TokenizerNS::Token("OUT", TokenizerNS::OP, Operator::WRITE), nullptr, val);
+		return new ASTNode_t(TokenizerNS::Token("OUT", TokenizerNS::OP, Operator::WRITE, line), nullptr, val);
 	}
 
 	ASTNode_t* ASTree::parse_sqrt(){
 		assert(cur_token->code == Operator::SQRT);
-		++cur_token;
+		uint32_t line = (cur_token++)->line;
 
 		ASTNode_t* val = parse_expression();
 
-		return new ASTNode_t(TokenizerNS::Token("SQRT", TokenizerNS::OP, Operator::SQRT), nullptr, val);
+		return new ASTNode_t(TokenizerNS::Token("SQRT", TokenizerNS::OP, Operator::SQRT, line), nullptr, val);
 	}
 
 	ASTNode_t* ASTree::parse_exit(){
 		assert(cur_token->code == Operator::EXIT);
-		++cur_token;
+		uint32_t line = (cur_token++)->line;
 
-		return new ASTNode_t(TokenizerNS::Token("EXIT", TokenizerNS::OP, Operator::EXIT));
+		return new ASTNode_t(TokenizerNS::Token("EXIT", TokenizerNS::OP, Operator::EXIT, line));
 	}
 
 	ASTNode_t* ASTree::parse_input(){
 		assert(cur_token->code == Operator::READ);
-		++cur_token;
+		uint32_t line = (cur_token++)->line;
 
 		ASTNode_t* var = parse_id();
 
-		return new ASTNode_t(TokenizerNS::Token("IN", TokenizerNS::OP, Operator::READ), nullptr, var);
+		return new ASTNode_t(TokenizerNS::Token("IN", TokenizerNS::OP, Operator::READ, line), nullptr, var);
 	}
 
 	ASTNode_t* ASTree::parse_expression(){
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+
+//growable machine code buffer owned by whoever encodes into it
+class CodeBuffer {
+private:
+	uint8_t* data_;
+	size_t size_;
+	size_t capacity_;
+
+	void reserve(size_t new_capacity){
+		if (new_capacity <= capacity_) return;
+
+		while (capacity_ < new_capacity) capacity_ *= 2;
+
+		data_ = static_cast<uint8_t*>(realloc(data_, capacity_));
+		assert(data_ != nullptr);
+	}
+
+public:
+	explicit CodeBuffer(size_t capacity = 4096): size_(0), capacity_((capacity > 0)?(capacity):(1)) {
+		data_ = static_cast<uint8_t*>(malloc(capacity_));
+		assert(data_ != nullptr);
+	}
+
+	CodeBuffer(const CodeBuffer&) = delete;
+	CodeBuffer& operator=(const CodeBuffer&) = delete;
+
+	~CodeBuffer(){
+		free(data_);
+	}
+
+	//returns room for the next n bytes, valid until the following append
+	uint8_t* append(size_t n){
+		reserve(size_ + n);
+
+		uint8_t* place = data_ + size_;
+		size_ += n;
+
+		return place;
+	}
+
+	void clear(){
+		size_ = 0;
+	}
+
+	uint8_t* data(){
+		return data_;
+	}
+
+	size_t size() const {
+		return size_;
+	}
+};
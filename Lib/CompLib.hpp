@@ -6,16 +6,23 @@
 #include <cassert>
 #include <cstdint>
 #include <map>
+#include <set>
 
 #include "DSL.h"
-#include "x86commandset.h"
 #include "../Vector/Vector.hpp"
+#include "x86commandset.h"
 #include "../HashTable/HashTable.cpp"
 
 namespace Consts {
 	constexpr int BUF_SIZE = 4096;
 };
 
+struct str_less {
+	bool operator()(const char* lhs, const char* rhs) const {
+		return strcmp(lhs, rhs) < 0;
+	}
+};
+
 inline unsigned long hash(const char* data){
     unsigned long h = 0;
 
@@ -0,0 +1,415 @@
+// Runtime of the generated code. Freestanding: no libc, input and output go straight to read(2) and write(2),
+// so it links into anything, e.g. with the compiler's own output:
+//
+//     g++ -c -O2 -ffreestanding -fno-exceptions -fno-asynchronous-unwind-tables -fno-stack-protector Lib/Runtime.cpp -o runtime.o
+//
+// main.cpp includes it as well, for code the compiler runs in process.
+#include "Runtime.hpp"
+
+namespace Runtime {
+	constexpr size_t BUFFER_SIZE = 1 << 16;
+	constexpr size_t MAX_NUM_LEN = 21; //sign and 19 digits of INT64_MIN, newline
+	constexpr size_t INPUT_SIZE  = 1 << 20;
+	constexpr size_t CHUNK       = 8;  //digits parsed at once
+
+	constexpr char DIGIT_PAIRS[] =
+		"00010203040506070809" "10111213141516171819" "20212223242526272829" "30313233343536373839" "40414243444546474849"
+		"50515253545556575859" "60616263646566676869" "70717273747576777879" "80818283848586878889" "90919293949596979899";
+
+	constexpr uint64_t POWERS_OF_10[] = {
+		1ul,             10ul,             100ul,             1000ul,             10000ul,
+		100000ul,        1000000ul,        10000000ul,        100000000ul,        1000000000ul,
+		10000000000ul,   100000000000ul,   1000000000000ul,   10000000000000ul,   100000000000000ul,
+		1000000000000000ul, 10000000000000000ul, 100000000000000000ul, 1000000000000000000ul, 10000000000000000000ul,
+	};
+
+	constexpr size_t NUM_POWERS = sizeof(POWERS_OF_10) / sizeof(POWERS_OF_10[0]);
+
+	static char output[BUFFER_SIZE];
+	static size_t output_used = 0;
+
+	constexpr size_t NUM_COUNTERS = Counter::MAX_LINES * Counter::MAX_SITES * Counter::NUM_KINDS;
+
+	constexpr int O_RDONLY = 00;
+	constexpr int O_WRONLY = 01;
+	constexpr int O_CREAT  = 0100;
+	constexpr int O_TRUNC  = 01000;
+
+	//zeros after the end keep a chunk load in bounds and stop it at the end of the input
+	static char input[INPUT_SIZE + CHUNK];
+	static size_t input_pos = 0;
+	static size_t input_end = 0;
+	static bool is_eof = false;
+
+	static long sys_write(int fd, const void* data, size_t size){
+		long result = 0;
+		asm volatile("syscall" : "=a"(result) : "a"(1), "D"(fd), "S"(data), "d"(size) : "rcx", "r11", "memory");
+
+		return result;
+	}
+
+	static long sys_read(int fd, void* data, size_t size){
+		long result = 0;
+		asm volatile("syscall" : "=a"(result) : "a"(0), "D"(fd), "S"(data), "d"(size) : "rcx", "r11", "memory");
+
+		return result;
+	}
+
+	static long sys_open(const char* filename, int flags, int mode){
+		long result = 0;
+		asm volatile("syscall" : "=a"(result) : "a"(2), "D"(filename), "S"(flags), "d"(mode) : "rcx", "r11", "memory");
+
+		return result;
+	}
+
+	static long sys_close(int fd){
+		long result = 0;
+		asm volatile("syscall" : "=a"(result) : "a"(3), "D"(fd) : "rcx", "r11", "memory");
+
+		return result;
+	}
+
+	static void write_all(int fd, const char* data, size_t size){
+		size_t done = 0;
+
+		while (done < size){
+			long written = sys_write(fd, data + done, size - done);
+			if (written <= 0) break;
+
+			done += written;
+		}
+	}
+
+	// Moves the unread tail to the front and reads until a whole chunk is available or the input ends.
+	static void refill(){
+		size_t left = input_end - input_pos;
+		for (size_t i = 0; i < left; ++i) input[i] = input[input_pos + i];
+
+		input_pos = 0;
+		input_end = left;
+
+		while (!is_eof && input_end < CHUNK){
+			long got = sys_read(0, input + input_end, INPUT_SIZE - input_end);
+
+			if (got <= 0) is_eof = true;
+			else          input_end += got;
+		}
+
+		for (size_t i = 0; i < CHUNK; ++i) input[input_end + i] = 0;
+	}
+
+	// Number of leading bytes of the chunk that are digits: a byte is one iff its high nibble is 3
+	// both before and after adding 6. A carry out of a byte only affects the bytes after it.
+	static size_t leading_digits(uint64_t chunk){
+		uint64_t bad = ((chunk & 0xF0F0F0F0F0F0F0F0ul) ^ 0x3030303030303030ul) |
+		               (((chunk + 0x0606060606060606ul) & 0xF0F0F0F0F0F0F0F0ul) ^ 0x3030303030303030ul);
+
+		return (bad == 0)?(CHUNK):(__builtin_ctzll(bad) / 8);
+	}
+
+	// The first len bytes of the chunk are digits, they are moved to the top so that the rest reads as
+	// leading zeros, then pairs, quads and the two halves are combined with multiplications.
+	static uint64_t parse_digits(uint64_t chunk, size_t len){
+		uint64_t digits = (chunk - 0x3030303030303030ul) << (8 * (CHUNK - len));
+
+		digits = (digits * 10) + (digits >> 8);
+		digits = (((digits & 0x000000FF000000FFul) * (100 + (1000000ul << 32))) +
+		          (((digits >> 16) & 0x000000FF000000FFul) * (1 + (10000ul << 32)))) >> 32;
+
+		return digits;
+	}
+
+	static size_t num_digits(uint64_t value){
+		size_t len = 1;
+		while (len < NUM_POWERS && value >= POWERS_OF_10[len]) ++len;
+
+		return len;
+	}
+
+	// Digits are written from the end, two at a time, returns where they start.
+	static char* put_digits(char* cur, uint64_t abs){
+		while (abs >= 100){
+			size_t pair = (abs % 100) * 2;
+			abs /= 100;
+
+			cur -= 2;
+			cur[0] = DIGIT_PAIRS[pair];
+			cur[1] = DIGIT_PAIRS[pair + 1];
+		}
+
+		if (abs >= 10){
+			cur -= 2;
+			cur[0] = DIGIT_PAIRS[abs * 2];
+			cur[1] = DIGIT_PAIRS[abs * 2 + 1];
+		}
+
+		else {
+			*--cur = '0' + abs;
+		}
+
+		return cur;
+	}
+
+	static uint32_t find_kind(const char* name, size_t len){
+		for (uint32_t kind = 0; kind < Counter::NUM_KINDS; ++kind){
+			const char* cur = Counter::KIND_NAMES[kind];
+
+			size_t i = 0;
+			while (i < len && cur[i] == name[i]) ++i;
+
+			if (i == len && cur[i] == '\0') return kind;
+		}
+
+		return Counter::NUM_KINDS;
+	}
+
+	// Adds the "line site kind count" records of an earlier run to the counters. The file is
+	// read in chunks and parsed a byte at a time, malformed records are skipped.
+	static void merge_counters(int fd, uint64_t* counters){
+		char chunk[4096];
+		char kind[8];
+
+		uint64_t fields[4] = {}; //line, site, kind, count
+		size_t field    = 0;
+		size_t kind_len = 0;
+		bool in_token   = false;
+		bool is_valid   = true;
+
+		for (;;){
+			long got = sys_read(fd, chunk, sizeof(chunk));
+			bool is_end = got <= 0;
+
+			if (is_end){
+				chunk[0] = '\n';
+				got = 1;
+			}
+
+			for (long i = 0; i < got; ++i){
+				char cur = chunk[i];
+
+				if (cur == ' ' || cur == '\t' || cur == '\n' || cur == '\r'){
+					if (in_token && field == 2) fields[2] = find_kind(kind, kind_len);
+					if (in_token) ++field;
+
+					in_token = false;
+					kind_len = 0;
+
+					if (cur != '\n') continue;
+
+					if (is_valid && field == 4 && fields[0] < Counter::MAX_LINES && fields[1] < Counter::MAX_SITES &&
+					    fields[2] < Counter::NUM_KINDS){
+						counters[Counter::key(fields[0], fields[1], (Counter::Kind)fields[2])] += fields[3];
+					}
+
+					fields[0] = fields[1] = fields[2] = fields[3] = 0;
+					field    = 0;
+					is_valid = true;
+					continue;
+				}
+
+				in_token = true;
+
+				if (field == 2){
+					if (kind_len < sizeof(kind)) kind[kind_len++] = cur;
+				}
+
+				else if (field < 4 && (unsigned char)(cur - '0') <= 9){
+					fields[field] = fields[field] * 10 + (cur - '0');
+				}
+
+				else is_valid = false;
+			}
+
+			if (is_end) break;
+		}
+	}
+};
+
+//_count reaches them rip-relative, so they are never looked up through the GOT
+extern "C" {
+	__attribute__((visibility("hidden"))) uint64_t aristotle_counters[Runtime::NUM_COUNTERS];
+	__attribute__((visibility("hidden"))) uint8_t  aristotle_is_counted; //set by every _count
+}
+
+extern "C" void aristotle_flush(){
+	Runtime::write_all(1, Runtime::output, Runtime::output_used);
+
+	Runtime::output_used = 0;
+}
+
+extern "C" void aristotle_write_num(int64_t value){
+	if (Runtime::output_used + Runtime::MAX_NUM_LEN > Runtime::BUFFER_SIZE) aristotle_flush();
+
+	uint64_t abs = (value < 0)?(0ul - (uint64_t)value):((uint64_t)value);
+	size_t len = Runtime::num_digits(abs) + (value < 0);
+
+	char* out = Runtime::output + Runtime::output_used;
+	char* cur = Runtime::put_digits(out + len, abs);
+
+	if (value < 0) *--cur = '-';
+
+	out[len] = '\n';
+	Runtime::output_used += len + 1;
+}
+
+// Skips to the next number and parses it 8 digits at a time, 0 at the end of the input.
+extern "C" int64_t aristotle_read_num(){
+	using namespace Runtime;
+
+	for (;;){
+		if (input_pos == input_end) refill();
+		if (input_pos == input_end) return 0;
+
+		char cur = input[input_pos];
+		if (cur == '-' || (unsigned char)(cur - '0') <= 9) break;
+
+		++input_pos;
+	}
+
+	bool is_negative = input[input_pos] == '-';
+	input_pos += is_negative;
+
+	uint64_t value = 0;
+
+	for (;;){
+		if (input_end - input_pos < CHUNK) refill();
+
+		uint64_t chunk = 0;
+		__builtin_memcpy(&chunk, input + input_pos, CHUNK);
+
+		size_t len = leading_digits(chunk);
+		if (len != 0) value = value * POWERS_OF_10[len] + parse_digits(chunk, len);
+
+		input_pos += len;
+
+		if (len < CHUNK && (input_pos < input_end || is_eof)) break;
+	}
+
+	return (is_negative)?(0ul - value):(value);
+}
+
+// Nothing is written unless instrumented code ran, otherwise the counts are merged with the file and it is rewritten.
+// Uninstrumented programs return before touching the counters, so their pages are never faulted in.
+extern "C" void aristotle_dump_counters(){
+	using namespace Runtime;
+
+	if (!aristotle_is_counted) return;
+
+	long fd = sys_open(Counter::FILE_NAME, O_RDONLY, 0);
+
+	if (fd >= 0){
+		merge_counters(fd, aristotle_counters);
+		sys_close(fd);
+	}
+
+	fd = sys_open(Counter::FILE_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return;
+
+	char records[4096];
+	size_t used = 0;
+
+	for (uint32_t key = 0; key < NUM_COUNTERS; ++key){
+		if (aristotle_counters[key] == 0) continue;
+
+		if (used + 2 * MAX_NUM_LEN + 8 > sizeof(records)){
+			write_all(fd, records, used);
+			used = 0;
+		}
+
+		uint32_t line = key / Counter::NUM_KINDS / Counter::MAX_SITES;
+		uint32_t site = key / Counter::NUM_KINDS % Counter::MAX_SITES;
+		const char* kind = Counter::KIND_NAMES[key % Counter::NUM_KINDS];
+
+		used += num_digits(line);
+		put_digits(records + used, line);
+		records[used++] = ' ';
+
+		used += num_digits(site);
+		put_digits(records + used, site);
+		records[used++] = ' ';
+
+		for (; *kind != '\0'; ++kind) records[used++] = *kind;
+		records[used++] = ' ';
+
+		used += num_digits(aristotle_counters[key]);
+		put_digits(records + used, aristotle_counters[key]);
+		records[used++] = '\n';
+	}
+
+	write_all(fd, records, used);
+	sys_close(fd);
+}
+
+__attribute__((destructor)) static void aristotle_flush_at_exit(){
+	aristotle_flush();
+	aristotle_dump_counters();
+}
+
+asm(R"(
+	.intel_syntax noprefix
+	.text
+	.globl _write_num
+_write_num:
+	push rax
+	push rcx
+	push rdx
+	push rsi
+	push rdi
+	push r8
+	push r9
+	push r10
+	push r11
+	push rbp
+	mov rbp, rsp
+	and rsp, -16
+	call aristotle_write_num@PLT
+	leave
+	pop r11
+	pop r10
+	pop r9
+	pop r8
+	pop rdi
+	pop rsi
+	pop rdx
+	pop rcx
+	pop rax
+	ret
+
+	.globl _read_num
+_read_num:
+	push rcx
+	push rdx
+	push rsi
+	push rdi
+	push r8
+	push r9
+	push r10
+	push r11
+	push rbp
+	mov rbp, rsp
+	and rsp, -16
+	call aristotle_read_num@PLT
+	leave
+	pop r11
+	pop r10
+	pop r9
+	pop r8
+	pop rdi
+	pop rsi
+	pop rdx
+	pop rcx
+	ret
+
+	.globl _count
+_count:
+	push rax
+	push rcx
+	mov eax, dword ptr [rsp + 24]
+	lea rcx, [rip + aristotle_counters]
+	add qword ptr [rcx + rax * 8], 1
+	mov byte ptr [rip + aristotle_is_counted], 1
+	pop rcx
+	pop rax
+	ret 8
+	.att_syntax prefix
+)");
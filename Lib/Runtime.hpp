@@ -0,0 +1,44 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+//Write from C++: formats into a 64KB buffer that is flushed when full and at exit
+extern "C" void aristotle_write_num(int64_t value);
+extern "C" void aristotle_flush();
+
+//Read from C++: the next integer on stdin, read in 1MB chunks, 0 once the input ends
+extern "C" int64_t aristotle_read_num();
+
+//Write from generated code: the value comes in rdi, every register is preserved, the stack may be misaligned
+extern "C" void _write_num();
+
+//Read from generated code: the value is returned in rax, every other register is preserved
+extern "C" void _read_num();
+
+//--instrument: generated code pushes the key of a block or a Ritual site and calls _count,
+//the counts are added to those of earlier runs in FILE_NAME at exit
+namespace Counter {
+	enum Kind : uint32_t {
+		BODY, //of a Theurgy, at its line
+		THEN, //arms of a Criterion, at its line
+		ELSE,
+		CALL, //Ritual sites
+		NUM_KINDS,
+	};
+
+	constexpr const char* KIND_NAMES[] = {"body", "then", "else", "call"};
+
+	constexpr uint32_t MAX_LINES = 1 << 13; //lines after it are not counted
+	constexpr uint32_t MAX_SITES = 8;       //Theurgies, Criteria or Rituals on one line, later ones are not counted
+	constexpr const char* FILE_NAME = "aristotle.profile";
+
+	//site is the ordinal of the Theurgy, Criterion or Ritual among those on its line
+	constexpr uint32_t key(uint32_t line, uint32_t site, Kind kind){
+		return (line * MAX_SITES + site) * NUM_KINDS + kind;
+	}
+};
+
+extern "C" void aristotle_dump_counters();
+
+//Counts from generated code: the key is pushed before the call and popped by it, every register is preserved
+extern "C" void _count();
@@ -33,6 +33,17 @@ void TNode_t<T>::remove_subtree(){
 	}
 }
 
+template <typename T>
+TNode_t<T>* TNode_t<T>::copy_subtree(){
+
+	TNode_t<T>* copy = new TNode_t<T>(this->key);
+
+	if (this->left_son  != nullptr) copy->attach_left (this->left_son->copy_subtree());
+	if (this->right_son != nullptr) copy->attach_right(this->right_son->copy_subtree());
+
+	return copy;
+}
+
 template <typename T>
 T TNode_t<T>::remove(){
 	
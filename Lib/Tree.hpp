@@ -26,6 +26,7 @@ public:
 
 	key_t remove();
 	void remove_subtree();
+	TNode_t* copy_subtree();
 
 	int is_left();
 	int is_right();
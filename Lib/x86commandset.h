@@ -1,18 +1,22 @@
 #pragma once
 #include "CompLib.hpp"
+#include "CodeBuffer.hpp"
 
 
 namespace Assembly {
 	const int UNUSED = 0;
+	const size_t MAX_LINE = 128; //longest line assembly() writes
 
 		enum Spec_t {
 			ORDINARY = 0,
 			LABEL = 1,
 			JUMP  = 2,
+			LOAD  = 3,
+			STORE = 4,
 		};
 
 	namespace Registers {
-		enum Reg {
+		enum Reg : int8_t {
 			NOT_REG = -1,
 			RAX,
 			RBX,
@@ -22,6 +26,8 @@ namespace Assembly {
 			RBP,
 			RSI,
 			RDI,
+			R8,
+			R9,
 			R10,
 			R11,
 			R12,
@@ -39,12 +45,14 @@ namespace Assembly {
 			5, //rbp
 			6, //rsi
 			7, //rdi
+			0, //r8
+			1, //r9
 			2, //r10
 			3, //r11
 			4, //r12
 			5, //r13
 			6, //r14
-
+			7, //r15
 		};
 	
 		const char* names[] = {
@@ -56,11 +64,14 @@ namespace Assembly {
 			"rbp",
 			"rsi",
 			"rdi",
+			"r8",
+			"r9",
 			"r10",
 			"r11",
 			"r12",
 			"r13",
 			"r14",
+			"r15",
 		};
 	};
 	
@@ -77,8 +88,9 @@ namespace Assembly {
 		
 		namespace PUSH {
 			enum {
-				REG = 0x50,
-				NUM = 0x68,
+				REG  = 0x50,
+				NUM  = 0x68,
+				NUM8 = 0x6A,
 			};
 		}
 	
@@ -92,21 +104,32 @@ namespace Assembly {
 			enum {
 				NUM = 0xC7,
 				REG = 0x89,
-				MEM = 0x8B
+				MEM = 0x8B,
+				IMM = 0xB8, //+ register, imm32 zero extended or imm64 with REX.W
 			};
 		};
 	
 		namespace CMP {
 			enum {
-				REG = 0x39
+				REG = 0x39,
+				MEM = 0x3B,
 			};
 		}
+
+		constexpr uint8_t LEA = 0x8D;
 	
 		namespace OP {
 			enum {
 				ADD  = 0x01,
 				SUB  = 0x29,
+				XOR  = 0x31,
 				IMUL = 0xAF,
+
+				ADD_MEM = 0x03,
+				SUB_MEM = 0x2B,
+
+				IMUL_IMM8  = 0x6B,
+				IMUL_IMM32 = 0x69,
 			};
 		}
 
@@ -115,6 +138,8 @@ namespace Assembly {
 				CALL = 0xE8,
 				JMP  = 0xE9,
 				RET  = 0xC3,
+				JMP_SHORT = 0xEB,
+				JCC_SHORT = 0x70, //+ the low nibble of the rel32 jcc opcode
 				JA   = 0x87,
 				JAE  = 0x83,
 				JB   = 0x82,
@@ -156,1093 +181,591 @@ namespace Assembly {
 	uint8_t reg_mask(uint8_t mask, Assembly::Registers::Reg dst){
 		return (mask | Registers::codes[dst]);
 	}
-	
-	
-	class Instruction {
-	public:
-
-		virtual void set_offset(int32_t) {return  ;}
-		virtual const char* assembly()   {return 0;}
-		virtual const char* string()     {return 0;}
-		virtual const uint8_t* elf()     {return 0;}
-		virtual size_t size()            {return 0;}
-		virtual Spec_t spec_type()       {return ORDINARY;}
-	};
-
-//===========================================================================//
-//                                   MOV
-//===========================================================================//
-
-	class MovReg2Reg: public Instruction {
-		private:
-			Registers::Reg src;
-			Registers::Reg dst;
-
-		public:
-			MovReg2Reg(Registers::Reg dst, Registers::Reg src): src(src), dst(dst){}
-
-			const char* assembly(){
-
-				static char output[128] = "";
-				sprintf(output, "\t\tmov %s, %s", Registers::names[dst], Registers::names[src]);
-
-				return output;
-			}
-
-			size_t size(){
-				return 3;
-			}
-
-			const uint8_t* elf(){
-				static uint8_t output[3] = {};
-				output[0] = Binary::get_prefix(src, dst);
-				output[1] = Binary::MOV::REG;
-				output[2] = reg_mask(0b11000000, src, dst);
-
-				return output;
-			}
-	};
-
-	class MovVal2Reg: public Instruction {
-	private:
-		Registers::Reg dst;
-		int32_t val;
-	
-	public:
-		MovVal2Reg(Registers::Reg dst, int32_t val): dst(dst), val(val) {}
-
-		const char* assembly(){
-			static char output[128] = "";
-			sprintf(output, "\t\tmov %s, %d", Registers::names[dst], val);
-			return output;
-		}
-
-		size_t size(){
-			return 7;
-		}
-
-		const uint8_t* elf(){
-			static uint8_t output[7] = {};
-
-			if (dst <= Registers::RDI){
-				output[0] = Binary::REX::W; 
-			}
-
-			else {
-				output[0] = Binary::REX::WB;
-			}
-
-			output[1] = Binary::MOV::NUM;
-			output[2] = reg_mask(0b11000000, dst);
-			
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&val);
-			memcpy(output + 3, val_code, 4);
-			return output;
-		}
-	};
-
-	class MovMem2Reg: public Instruction {
-	private:
-		Registers::Reg src_reg = Registers::NOT_REG;
-		const char* src_label = nullptr;
-		Registers::Reg dst;
-		int8_t offset = UNUSED;
-
-	public:
-		MovMem2Reg(Registers::Reg dst, Registers::Reg src_reg, int8_t offset): src_reg(src_reg), dst(dst), offset(offset) {}
-
-		MovMem2Reg(Registers::Reg dst, const char* src_label): src_label(src_label), dst(dst) {}
-		MovMem2Reg(Registers::Reg dst, int8_t offset): dst(dst), offset(offset) {}
-
-		const char* assembly(){
-
-			static char output[128] = "";
-
-			if (src_reg != Registers::NOT_REG){
-				sprintf(output, "\t\tmov %s, [%s + %d]", Registers::names[dst], Registers::names[src_reg], offset);
-			}
-
-			else if (offset != UNUSED) {
-				sprintf(output, "\t\tmov %s, [%d]", Registers::names[dst], offset);
-			}
-
-			else {
-				sprintf(output, "\t\tmov %s, %s", Registers::names[dst], src_label);
-			}
-
-			return output;
-		}
 
-		size_t size(){
-			return 4;
-		}
-
-		const uint8_t* elf(){
-			static uint8_t output[4] = {Binary::REX::WR, Binary::MOV::MEM, 0x55 };
-
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&offset);
-			memcpy(output + 3, val_code, 1);
-
-			return output;
-		}
-
-	};
-	
-	class MovReg2Mem: public Instruction {
-	private:
-		Registers::Reg src_reg = Registers::NOT_REG;
-		Registers::Reg dst;
-		int32_t offset = 0;
-
-	public:
-		MovReg2Mem(Registers::Reg dst, int32_t offset, Registers::Reg src_reg): src_reg(src_reg), dst(dst), offset(offset) {}
-		MovReg2Mem(int32_t offset, Registers::Reg src_reg): src_reg(src_reg), offset(offset) {}
-
-		const char* assembly(){
-
-			static char output[128] = "";
-
-			if (src_reg != Registers::NOT_REG){
-				sprintf(output, "\t\tmov [%s + %d], %s", Registers::names[dst], offset, Registers::names[src_reg]);
-			}
-
-			else {
-				sprintf(output, "\t\tmov [%d], %s", offset, Registers::names[src_reg]);
-			}
-
-			return output;
-		}
-
-		size_t size(){
-			return 7;
-		}
-
-		const uint8_t* elf(){
-			static uint8_t output[7] = {0x90, Binary::MOV::REG, 0x95};
-			output[0] = Binary::get_prefix(src_reg, dst);
-
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&offset);
-			memcpy(output + 3, val_code, 4);
-
-			return output;
-		}
-	};
-
-//===========================================================================//
-//                                   ADD
-//===========================================================================//
-
-	class AddReg2Reg: public Instruction {
-	private:
-		Registers::Reg dst;
-		Registers::Reg src;
-
-	public:	
-		AddReg2Reg(Registers::Reg dst, Registers::Reg src): dst(dst), src(src) {};
-
-		const char* assembly(){
-
-			static char output[128] = "";
-			sprintf(output, "\t\tadd %s, %s", Registers::names[dst], Registers::names[src]);
-
-			return output;
-		}
-
-		size_t size(){
-			return 3;
-		}
-
-		const uint8_t* elf(){
-			static uint8_t output[3] = {0x90, Binary::OP::ADD, 0x90};
-			output[0] = Binary::get_prefix(src, dst);
-			output[2] = reg_mask(0b11000000, src, dst);
-			return output;
-		}
-	};
+	bool is_imm8(int64_t val){
+		return val >= INT8_MIN && val <= INT8_MAX;
+	}
 
-	class AddVal2Reg: public Instruction {
-	private:
-		Registers::Reg dst;
-		int8_t src = 0;
+	bool is_imm32(int64_t val){
+		return val >= INT32_MIN && val <= INT32_MAX;
+	}
 
-	public:	
-		AddVal2Reg(Registers::Reg dst, int8_t src): dst(dst), src(src) {};
+	bool is_uimm32(int64_t val){
+		return val >= 0 && val <= UINT32_MAX;
+	}
 
-		const char* assembly(){
+	bool is_extended(Registers::Reg reg){
+		return reg > Registers::RDI;
+	}
 
-			static char output[128] = "";
-			sprintf(output, "\t\tadd %s, %d", Registers::names[dst], src); 
+	//REX.W with R, X and B taken from the ModRM reg, SIB index and base/rm registers
+	uint8_t rex(Registers::Reg reg, Registers::Reg index, Registers::Reg base){
+		uint8_t prefix = Binary::REX::W;
 
-			return output;
-		}
+		if (reg   != Registers::NOT_REG && is_extended(reg))   prefix |= 0b100;
+		if (index != Registers::NOT_REG && is_extended(index)) prefix |= 0b010;
+		if (base  != Registers::NOT_REG && is_extended(base))  prefix |= 0b001;
 
-		size_t size(){
-			return 4;
-		}
+		return prefix;
+	}
 
-		const uint8_t* elf(){
-			static uint8_t output[4] = {Binary::REX::W, 0x83, 0xC4};
+	size_t mem_size(Registers::Reg base, Registers::Reg index, int32_t disp){
+		size_t size = 1;
 
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&src);
-			memcpy(output + 3, val_code, 1);
-			return output;
-		}
-	};
+		if (index != Registers::NOT_REG || Registers::codes[base] == 4) ++size;
 
+		if (disp == 0 && Registers::codes[base] != 5) return size;
 
-//===========================================================================//
-//                                    SUB
-//===========================================================================//
-
-	class SubReg2Reg: public Instruction {
-	private:
-		Registers::Reg dst;
-		Registers::Reg src;
+		return size + ((is_imm8(disp))?(1):(4));
+	}
 
-	public:	
-		SubReg2Reg(Registers::Reg dst, Registers::Reg src): dst(dst), src(src) {};
+	//ModRM, SIB and displacement of [base + index + disp], returns the number of bytes written
+	size_t encode_mem(uint8_t* output, uint8_t reg_code, Registers::Reg base, Registers::Reg index, int32_t disp){
+		uint8_t mod = 0b10000000;
 
-		const char* assembly(){
+		if (disp == 0 && Registers::codes[base] != 5) mod = 0b00000000;
+		else if (is_imm8(disp))                     mod = 0b01000000;
 
-			static char output[128] = "";
-			sprintf(output, "\t\tsub %s, %s", Registers::names[dst], Registers::names[src]);
+		size_t size = 0;
 
-			return output;
-		}
+		if (index != Registers::NOT_REG || Registers::codes[base] == 4){
+			uint8_t index_code = (index != Registers::NOT_REG)?(Registers::codes[index]):(4);
 
-		size_t size(){
-			return 3;
+			output[size++] = mod | (reg_code << 3) | 0b100;
+			output[size++] = (index_code << 3) | Registers::codes[base];
 		}
 
-		const uint8_t* elf(){
-			static uint8_t output[3] = {0x90, Binary::OP::SUB, 0x90};
-			output[0] = Binary::get_prefix(src, dst);
-			output[2] = reg_mask(0b11000000, src, dst);
-			return output;
+		else {
+			output[size++] = mod | (reg_code << 3) | Registers::codes[base];
 		}
-	};
-
-
-	class SubReg2Val: public Instruction {
-	private:
-		Registers::Reg dst;
-		int8_t val;
-
-	public:	
-		SubReg2Val(Registers::Reg dst, int8_t val): dst(dst), val(val) {};
-
-		const char* assembly(){
-
-			static char output[128] = "";
-			sprintf(output, "\t\tsub %s, %d", Registers::names[dst], val);
 
-			return output;
+		if (mod == 0b01000000){
+			output[size++] = (uint8_t)disp;
 		}
 
-		size_t size(){
-			return 4;
+		else if (mod == 0b10000000){
+			memcpy(output + size, &disp, 4);
+			size += 4;
 		}
 
-		const uint8_t* elf(){
-			static uint8_t output[4] = {Binary::REX::W, 0x83, 0xEC};
-
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&val);
-			memcpy(output + 3, val_code, 1);
-			return output;
-		}
-	};
-
-//===========================================================================//
-//                                   MUL
-//===========================================================================//
-
-	class MulReg2Reg: public Instruction {
-	private:
-		Registers::Reg dst;
-		Registers::Reg src;
-
-	public:	
-		MulReg2Reg(Registers::Reg dst, Registers::Reg src): dst(dst), src(src) {};
-
-		const char* assembly(){
-
-			static char output[128] = "";
-			sprintf(output, "\t\timul %s, %s", Registers::names[dst], Registers::names[src]);
+		return size;
+	}
 
-			return output;
-		}
+	//op r64, imm8 / imm32 through the 0x83 / 0x81 group, ext selects the operation
+	size_t encode_imm(uint8_t* output, uint8_t ext, Registers::Reg dst, int32_t val){
+		output[0] = rex(Registers::NOT_REG, Registers::NOT_REG, dst);
+		output[1] = (is_imm8(val))?(0x83):(0x81);
+		output[2] = reg_mask(0b11000000 | (ext << 3), dst);
 
-		size_t size(){
+		if (is_imm8(val)){
+			output[3] = (uint8_t)val;
 			return 4;
 		}
 
-		const uint8_t* elf(){
-			static uint8_t output[4] = {Binary::REX::WRB, 0x0F, Binary::OP::IMUL, 0x90};
-			output[3] = reg_mask(0b11000000, dst, src);
-			return output;
-		}
-	};
-
-//===========================================================================//
-//                                  DIV
-//===========================================================================//
-
-	class DivReg2Reg: public Instruction {
-	private:
-		Registers::Reg dst;
-		Registers::Reg src;
-
-	public:	
-		DivReg2Reg(Registers::Reg dst, Registers::Reg src): dst(dst), src(src) {};
-
-		const char* assembly(){
-
-			static char output[128] = "";
-			sprintf(output, "\t\tdiv %s, %s", Registers::names[dst], Registers::names[src]);
-
-			return output;
-		}
-	};
-
-//===========================================================================//
-//                                  RET
-//===========================================================================//
-
-	class Ret: public Instruction {
-	public:	
-		const char* assembly(){
-			static char output[128] = "\t\tret";
-			return output;
-		}
-
-		size_t size(){
-			return 1;
-		}
-
-		const uint8_t* elf(){
-			static uint8_t output[1] = {0xC3};
-			return output;
-		}
-	};
-
-//===========================================================================//
-//                                  JMP
-//===========================================================================//
-//
-	class Jmp: public Instruction {
-	private:
-		int32_t offset = 0;
-		int64_t num = UNUSED;
-		const char* label;
-
-	public:	
-		Jmp(const char* label): label(label) {};
-		Jmp(int64_t num): num(num) {};
-
-		const char* assembly(){
-			static char output[128] = "";
-			if (num == UNUSED){
-				sprintf(output, "\t\tjmp %s", label); 
-			}
-
-			else {
-				sprintf(output, "\t\tjmp .Block%ld", num); 
-			}
-
-			return output;
-		}
-
-		void set_offset(int32_t new_offset){
-			offset = new_offset;
-		}
-
-		const char* string(){
-			char* output = new char[128]();
-			if (num == UNUSED){
-				sprintf(output, "%s", label); 
-			}
-
-			else {
-				sprintf(output, ".Block%ld", num); 
-			}
-
-			return output;
-		}
-
-		size_t size(){
-			return 5;
-		}
-
-
-		const uint8_t* elf(){
-			static uint8_t output[5] = {Binary::JMP::JMP}; 
-		
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&offset);
-			memcpy(output + 1, val_code, 4);
-
-			return output;
-		}
-
-		Spec_t spec_type(){
-			return JUMP;
-		}
-	};
-
-	class Jz: public Instruction {
-	private:
-		int32_t offset = 0;
-		int64_t num = UNUSED;
-		const char* label;
-
-	public:	
-		Jz(const char* label): label(label) {};
-		Jz(int64_t num): num(num) {};
-
-		const char* assembly(){
-			static char output[128] = "";
-			if (num == UNUSED){
-				sprintf(output, "\t\tjz %s", label); 
-			}
-			
-			else {
-				sprintf(output, "\t\tjz .Block%ld", num); 
-			}
-
-			return output;
-		}
-
-		const char* string(){
-			char* output = new char[128]();
-			if (num == UNUSED){
-				sprintf(output, "%s", label); 
-			}
-
-			else {
-				sprintf(output, ".Block%ld", num); 
-			}
-
-			return output;
-		}
-
-
-		void set_offset(int32_t new_offset){
-			offset = new_offset;
-		}
-
-		size_t size(){
-			return 6;
-		}
-
-		const uint8_t* elf(){
-			static uint8_t output[6] = {0x0F, Binary::JMP::JE}; 
-		
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&offset);
-			memcpy(output + 2, val_code, 4);
-
-			return output;
-		}
+		memcpy(output + 3, &val, 4);
+		return 7;
+	}
 
-		Spec_t spec_type(){
-			return JUMP;
-		}
-	};
+	size_t imm_size(int32_t val){
+		return (is_imm8(val))?(4):(7);
+	}
 
-	class Jnz: public Instruction {
-	private:
-		int32_t offset = 0;
-		int64_t num = UNUSED;
-		const char* label = nullptr;
-
-	public:	
-		Jnz(const char* label): label(label) {};
-		Jnz(int64_t num): num(num) {};
-
-		const char* assembly(){
-			static char output[128] = "";
-			if (num == UNUSED){
-				sprintf(output, "\t\tjnz %s", label); 
-			}
+	//mov r64, imm: mov r32, imm32 when it zero extends, REX.W C7 imm32 when it sign extends, movabs otherwise
+	size_t mov_imm_size(Registers::Reg dst, int64_t val){
+		if (is_uimm32(val)) return (is_extended(dst))?(6):(5);
+		if (is_imm32(val))  return 7;
 
-			else {
-				sprintf(output, "\t\tjnz .Block%ld", num); 
-			}
+		return 10;
+	}
 
-			return output;
-		}
+	size_t encode_mov_imm(uint8_t* output, Registers::Reg dst, int64_t val){
+		size_t size = 0;
 
-		const char* string(){
-			char* output = new char[128]();
-			if (num == UNUSED){
-				sprintf(output, "%s", label); 
-			}
+		if (is_uimm32(val)){
+			if (is_extended(dst)) output[size++] = Binary::REX::B;
 
-			else {
-				sprintf(output, ".Block%ld", num); 
-			}
+			output[size++] = reg_mask(Binary::MOV::IMM, dst);
+			memcpy(output + size, &val, 4);
 
-			return output;
+			return size + 4;
 		}
 
+		if (is_imm32(val)){
+			int32_t imm = (int32_t)val;
 
-		void set_offset(int32_t new_offset){
-			offset = new_offset;
-		}
+			output[0] = rex(Registers::NOT_REG, Registers::NOT_REG, dst);
+			output[1] = Binary::MOV::NUM;
+			output[2] = reg_mask(0b11000000, dst);
+			memcpy(output + 3, &imm, 4);
 
-		size_t size(){
-			return 6;
+			return 7;
 		}
 
-		const uint8_t* elf(){
-			static uint8_t output[6] = {0x0F, Binary::JMP::JNE}; 
-		
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&offset);
-			memcpy(output + 2, val_code, 4);
-
-			return output;
-			
-		}
+		output[0] = rex(Registers::NOT_REG, Registers::NOT_REG, dst);
+		output[1] = reg_mask(Binary::MOV::IMM, dst);
+		memcpy(output + 2, &val, 8);
 
-		Spec_t spec_type(){
-			return JUMP;
-		}
+		return 10;
+	}
+	
+	
+	namespace Opcodes {
+		enum Op : uint8_t {
+			NONE = 0,
+			MOV_RR,
+			MOV_RI,
+			LOAD,
+			LOAD_LABEL,
+			STORE,
+			ADD_RR,
+			ADD_RI,
+			ADD_RM,
+			SUB_RR,
+			SUB_RI,
+			SUB_RM,
+			IMUL_RR,
+			IMUL_RI,
+			IMUL_RM,
+			LEA,
+			IDIV,
+			CQO,
+			XOR_RR,
+			CMP_RR,
+			CMP_RI,
+			CMP_RM,
+			PUSH,
+			PUSH_I,
+			POP,
+			CALL,
+			JMP,
+			JZ,
+			JNZ,
+			JG,
+			JGE,
+			JL,
+			JLE,
+			RET,
+			SYSCALL,
+			LABEL,
+			NUM_OPS,
+		};
 	};
 
-	class Jg: public Instruction {
-	private:
-		int32_t offset = 0;
-		int64_t num = -1;
-		const char* label = nullptr;
-
-	public:	
-		Jg(const char* label): label(label) {};
-		Jg(int64_t num): num(num) {};
-
-		const char* assembly(){
-			static char output[128] = "";
-			if (num == UNUSED){
-				sprintf(output, "\t\tjg %s", label); 
-			}
-
-			else {
-				sprintf(output, "\t\tjg .Block%ld", num); 
-			}
-
-			return output;
-		}
-
-		const char* string(){
-			char* output = new char[128]();
-			if (num == -1){
-				sprintf(output, "%s", label); 
-			}
-
-			else {
-				sprintf(output, ".Block%ld", num); 
-			}
-
-			return output;
-		}
-
-
-		void set_offset(int32_t new_offset){
-			offset = new_offset;
-		}
-
-		size_t size(){
-			return 6;
-		}
-
-		const uint8_t* elf(){
-			static uint8_t output[6] = {0x0F, Binary::JMP::JG}; 
-		
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&offset);
-			memcpy(output + 2, val_code, 4);
-
-			return output;
-		}
+	const int32_t NO_LABEL = -1;
 
-		Spec_t spec_type(){
-			return JUMP;
-		}
+	//dense id of a label: Theurgies, runtime entry points, data and blocks
+	struct Symbol {
+		int32_t id = NO_LABEL;
 	};
 
-	class Jge: public Instruction {
-	private:
-		int32_t offset = 0;
-		int64_t num = UNUSED;
-		const char* label;
-
-	public:	
-		Jge(const char* label): label(label) {};
-		Jge(int64_t num): num(num) {};
-
-		const char* assembly(){
-			static char output[128] = "";
-			if (num == UNUSED){
-				sprintf(output, "\t\tjge %s", label); 
-			}
-
-			else {
-				sprintf(output, "\t\tjge .Block%ld", num); 
-			}
-
-			return output;
-		}
-
-		const char* string(){
-			char* output = new char[128]();
-			if (num == UNUSED){
-				sprintf(output, "%s", label); 
-			}
-
-			else {
-				sprintf(output, ".Block%ld", num); 
-			}
-
-			return output;
-		}
-
-
-		void set_offset(int32_t new_offset){
-			offset = new_offset;
-		}
-
-		size_t size(){
-			return 6;
-		}
-
-		const uint8_t* elf(){
-			static uint8_t output[6] = {0x0F, Binary::JMP::JGE}; 
-		
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&offset);
-			memcpy(output + 2, val_code, 4);
-
-			return output;
-		}
-
-		Spec_t spec_type(){
-			return JUMP;
-		}
+	//one instruction of the generated code, passes and write_elf walk flat arrays of them
+	struct Instruction {
+		Opcodes::Op op = Opcodes::NONE;
+		Registers::Reg dst   = Registers::NOT_REG; //base register for stores
+		Registers::Reg src   = Registers::NOT_REG; //base register for loads
+		Registers::Reg index = Registers::NOT_REG; //lea only
+		int32_t label = NO_LABEL;                  //of labels, jumps, calls and LOAD_LABEL
+		int64_t imm   = 0;                         //immediate or displacement, only mov takes an imm64
 	};
 
+	static_assert(sizeof(Instruction) == 16, "Instruction records are meant to stay 16 bytes");
 
-	class Jl: public Instruction {
+	//names of the labels, blocks have none
+	class SymbolTable {
 	private:
-		int32_t offset = 0;
-		int64_t num = UNUSED;
-		const char* label;
-
-	public:	
-		Jl(const char* label): label(label) {};
-		Jl(int64_t num): num(num) {};
-
-		const char* assembly(){
-			static char output[128] = "";
-			if (num == UNUSED){
-				sprintf(output, "\t\tjl %s", label); 
-			}
-
-			else {
-				sprintf(output, "\t\tjl .Block%ld", num); 
-			}
-
-			return output;
-		}
+		Vector<const char*> names;
 
-		const char* string(){
-			char* output = new char[128]();
-			if (num == UNUSED){
-				sprintf(output, "%s", label); 
-			}
+	public:
+		//there are only as many named symbols as Theurgies, a linear search is enough
+		Symbol intern(const char* name){
+			assert(name != nullptr);
 
-			else {
-				sprintf(output, ".Block%ld", num); 
+			for (size_t i = 0; i < names.size(); ++i){
+				if (names[i] != nullptr && strcmp(names[i], name) == 0) return {(int32_t)i};
 			}
 
-			return output;
-		}
-
-
-		void set_offset(int32_t new_offset){
-			offset = new_offset;
+			names.push_back(name);
+			return {(int32_t)(names.size() - 1)};
 		}
 
-		size_t size(){
-			return 6;
+		Symbol block(){
+			names.push_back(nullptr);
+			return {(int32_t)(names.size() - 1)};
 		}
 
-		const uint8_t* elf(){
-			static uint8_t output[6] = {0x0F, Binary::JMP::JL}; 
-		
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&offset);
-			memcpy(output + 2, val_code, 4);
+		//NO_LABEL when nothing by that name was interned
+		int32_t find(const char* name){
+			assert(name != nullptr);
 
-			return output;
-		}
-
-		Spec_t spec_type(){
-			return JUMP;
-		}
-	};
-
-	class Jle: public Instruction {
-	private:
-		int32_t offset = 0;
-		int64_t num = UNUSED;
-		const char* label;
-
-	public:	
-		Jle(const char* label): label(label) {};
-		Jle(int64_t num): num(num) {};
-
-		const char* assembly(){
-			static char output[128] = "";
-			if (num == UNUSED){
-				sprintf(output, "\t\tjle %s", label); 
-			}
-
-			else {
-				sprintf(output, "\t\tjle .Block%ld", num); 
+			for (size_t i = 0; i < names.size(); ++i){
+				if (names[i] != nullptr && strcmp(names[i], name) == 0) return (int32_t)i;
 			}
 
-			return output;
+			return NO_LABEL;
 		}
 
-		const char* string(){
-			char* output = new char[128]();
-			if (num == UNUSED){
-				sprintf(output, "%s", label); 
-			}
-
-			else {
-				sprintf(output, ".Block%ld", num); 
-			}
-
-			return output;
+		bool is_named(int32_t id){
+			return name(id) != nullptr;
 		}
 
-
-		void set_offset(int32_t new_offset){
-			offset = new_offset;
+		const char* name(int32_t id){
+			assert(id >= 0 && (size_t)id < names.size());
+			return names[id];
 		}
 
 		size_t size(){
-			return 6;
+			return names.size();
 		}
 
-		const uint8_t* elf(){
-			static uint8_t output[6] = {0x0F, Binary::JMP::JLE}; 
-		
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&offset);
-			memcpy(output + 2, val_code, 4);
-
-			return output;
-		}
-
-		Spec_t spec_type(){
-			return JUMP;
-		}
-	};
-
-	class Call: public Instruction {
-	private:
-		int32_t offset = 0;
-		const char* label;
-
-	public:	
-		Call(const char* label): label(label) {};
-
-		const char* assembly(){
-			static char output[128] = "";
-			sprintf(output, "\t\tcall %s", label); 
-
-			return output;
-		}
-
-		void set_offset(int32_t new_offset){
-			offset = new_offset;
-		}
-
-		const char* string(){
-			char* output = new char[128]();
-			sprintf(output, "%s", label); 
-			return output;
-		}
-
-
-		size_t size(){
-			return 5;
-		}
-
-		const uint8_t* elf(){
-			static uint8_t output[5] = {Binary::JMP::CALL}; 
-		
-			const uint8_t* val_code = reinterpret_cast<const uint8_t*>(&offset);
-			memcpy(output + 1, val_code, 4);
-
-			return output;
-		}
-
-		Spec_t spec_type(){
-			return JUMP;
+		void clear(){
+			names.resize(0);
 		}
 	};
 
 //===========================================================================//
-//                                  CMP
+//                                 ENCODING
 //===========================================================================//
 
-	class CmpReg2Reg: public Instruction {
-	private:
-		Registers::Reg dst;
-		Registers::Reg src;
-	
-	public:
-		CmpReg2Reg(Registers::Reg dst, Registers::Reg src): dst(dst), src(src){};
-		const char* assembly(){
-			static char output[128] = "";
-			sprintf(output, "\t\tcmp %s, %s", Registers::names[dst], Registers::names[src]); 
-			return output;
-		}
-
-		size_t size(){
-			return 3;
-		}
-
-		const uint8_t* elf(){
-			static uint8_t output[3] = {0x90, Binary::CMP::REG, 0x90}; 
-			output[0] = Binary::get_prefix(src, dst);
-			output[2] = reg_mask(0b11000000, src, dst);
-
-			return output;
-		}
+	//displacement of a jump or call, patched once every label is placed,
+	//or a reference to a symbol outside the code that is left to the linker
+	struct Fixup {
+		size_t pos;    //of the displacement in the code buffer
+		uint8_t size;  //1 or 4 bytes
+		int32_t label;
+		Opcodes::Op op;
+	};
+
+	namespace Format {
+		enum Form : uint8_t {
+			NONE,    //no bytes: labels
+			FIXED,   //the opcode bytes alone
+			RR,      //op r/m64, r64:         REX.W op ModRM(src, dst)
+			RR_REV,  //op r64, r/m64:         REX.W op ModRM(dst, src)
+			RI,      //op r/m64, imm8/imm32:  REX.W 83/81 ModRM(ext, dst) imm
+			MOV_RI,  //mov r64, imm32/imm64:  see mov_imm_size
+			ADDR,    //mov r/m64, imm32:      REX.W C7 ModRM(0, dst) address
+			IMUL_RI, //imul r64, r/m64, imm:  REX.W 6B/69 ModRM(dst, src) imm
+			RM,      //op r64, [src + index + imm]
+			STORE,   //mov [dst + imm], src
+			SHORT,   //push/pop: opcode + register
+			PUSH_I,  //push imm8/imm32:       6A ib or 68 id, sign extended to 64 bits
+			UNARY,   //op r/m64:              REX.W op ModRM(ext, src)
+			REL,     //call, jmp and jcc rel32, or rel8 through short_opcode
+		};
 	};
 
-//===========================================================================//
-//                                 PUSH
-//===========================================================================//
-
-	class PushReg: public Instruction {
-	private:
-		Registers::Reg src;
-	
-	public:
-		PushReg(Registers::Reg src): src(src){};
-
-		const char* assembly(){
-			static char output[128] = "";
-			sprintf(output, "\t\tpush %s", Registers::names[src]); 
-			return output;
-		}
-
-		size_t size(){
-			if (src <= Assembly::Registers::RDI){
-				return 1;
-			}
-
-			return 2;
-		}
-
-		const uint8_t* elf(){
-			static uint8_t output[2] = {}; 
-			if (src <= Assembly::Registers::RDI){
-				output[0] = reg_mask(Binary::PUSH::REG, src);
-			}
-
-			else {
-				output[0] = Binary::REX::B;
-				output[1] = reg_mask(Binary::PUSH::REG, src);
-			}
+	struct Encoding {
+		const char* mnemonic;
+		Format::Form form;
+		uint8_t opcode[2];
+		uint8_t opcode_size;
+		uint8_t ext;   //ModRM.reg of group opcodes
+		Spec_t spec;
+		uint8_t short_opcode; //rel8 form of jumps, 0 if there is none
+	};
+
+	const Encoding ENCODINGS[] = {
+		/* NONE       */ {"",        Format::NONE,    {},                             0, 0, ORDINARY, 0},
+		/* MOV_RR     */ {"mov",     Format::RR,      {Binary::MOV::REG},             1, 0, ORDINARY, 0},
+		/* MOV_RI     */ {"mov",     Format::MOV_RI,  {Binary::MOV::NUM},             1, 0, ORDINARY, 0},
+		/* LOAD       */ {"mov",     Format::RM,      {Binary::MOV::MEM},             1, 0, LOAD, 0},
+		/* LOAD_LABEL */ {"mov",     Format::ADDR,    {Binary::MOV::NUM},             1, 0, ORDINARY, 0},
+		/* STORE      */ {"mov",     Format::STORE,   {Binary::MOV::REG},             1, 0, STORE, 0},
+		/* ADD_RR     */ {"add",     Format::RR,      {Binary::OP::ADD},              1, 0, ORDINARY, 0},
+		/* ADD_RI     */ {"add",     Format::RI,      {},                             0, 0, ORDINARY, 0},
+		/* ADD_RM     */ {"add",     Format::RM,      {Binary::OP::ADD_MEM},          1, 0, LOAD, 0},
+		/* SUB_RR     */ {"sub",     Format::RR,      {Binary::OP::SUB},              1, 0, ORDINARY, 0},
+		/* SUB_RI     */ {"sub",     Format::RI,      {},                             0, 5, ORDINARY, 0},
+		/* SUB_RM     */ {"sub",     Format::RM,      {Binary::OP::SUB_MEM},          1, 0, LOAD, 0},
+		/* IMUL_RR    */ {"imul",    Format::RR_REV,  {0x0F, Binary::OP::IMUL},       2, 0, ORDINARY, 0},
+		/* IMUL_RI    */ {"imul",    Format::IMUL_RI, {},                             0, 0, ORDINARY, 0},
+		/* IMUL_RM    */ {"imul",    Format::RM,      {0x0F, Binary::OP::IMUL},       2, 0, LOAD, 0},
+		/* LEA        */ {"lea",     Format::RM,      {Binary::LEA},                  1, 0, ORDINARY, 0},
+		/* IDIV       */ {"idiv",    Format::UNARY,   {0xF7},                         1, 7, ORDINARY, 0},
+		/* CQO        */ {"cqo",     Format::FIXED,   {Binary::REX::W, 0x99},         2, 0, ORDINARY, 0},
+		/* XOR_RR     */ {"xor",     Format::RR,      {Binary::OP::XOR},              1, 0, ORDINARY, 0},
+		/* CMP_RR     */ {"cmp",     Format::RR,      {Binary::CMP::REG},             1, 0, ORDINARY, 0},
+		/* CMP_RI     */ {"cmp",     Format::RI,      {},                             0, 7, ORDINARY, 0},
+		/* CMP_RM     */ {"cmp",     Format::RM,      {Binary::CMP::MEM},             1, 0, LOAD, 0},
+		/* PUSH       */ {"push",    Format::SHORT,   {Binary::PUSH::REG},            1, 0, ORDINARY, 0},
+		/* PUSH_I     */ {"push",    Format::PUSH_I,  {Binary::PUSH::NUM},            1, 0, ORDINARY, 0},
+		/* POP        */ {"pop",     Format::SHORT,   {Binary::POP::REG},             1, 0, ORDINARY, 0},
+		/* CALL       */ {"call",    Format::REL,     {Binary::JMP::CALL},            1, 0, JUMP, 0},
+		/* JMP        */ {"jmp",     Format::REL,     {Binary::JMP::JMP},             1, 0, JUMP, Binary::JMP::JMP_SHORT},
+		/* JZ         */ {"jz",      Format::REL,     {0x0F, Binary::JMP::JE},        2, 0, JUMP, Binary::JMP::JCC_SHORT | (Binary::JMP::JE  & 0x0F)},
+		/* JNZ        */ {"jnz",     Format::REL,     {0x0F, Binary::JMP::JNE},       2, 0, JUMP, Binary::JMP::JCC_SHORT | (Binary::JMP::JNE & 0x0F)},
+		/* JG         */ {"jg",      Format::REL,     {0x0F, Binary::JMP::JG},        2, 0, JUMP, Binary::JMP::JCC_SHORT | (Binary::JMP::JG  & 0x0F)},
+		/* JGE        */ {"jge",     Format::REL,     {0x0F, Binary::JMP::JGE},       2, 0, JUMP, Binary::JMP::JCC_SHORT | (Binary::JMP::JGE & 0x0F)},
+		/* JL         */ {"jl",      Format::REL,     {0x0F, Binary::JMP::JL},        2, 0, JUMP, Binary::JMP::JCC_SHORT | (Binary::JMP::JL  & 0x0F)},
+		/* JLE        */ {"jle",     Format::REL,     {0x0F, Binary::JMP::JLE},       2, 0, JUMP, Binary::JMP::JCC_SHORT | (Binary::JMP::JLE & 0x0F)},
+		/* RET        */ {"ret",     Format::FIXED,   {Binary::JMP::RET},             1, 0, ORDINARY, 0},
+		/* SYSCALL    */ {"syscall", Format::FIXED,   {0x0F, 0x05},                   2, 0, ORDINARY, 0},
+		/* LABEL      */ {"",        Format::NONE,    {},                             0, 0, LABEL, 0},
+	};
+
+	static_assert(sizeof(ENCODINGS) / sizeof(ENCODINGS[0]) == Opcodes::NUM_OPS, "Every opcode needs an encoding");
+
+	Spec_t spec_type(const Instruction& ins){
+		return ENCODINGS[ins.op].spec;
+	}
 
-			return output;
-		}
-	};
+	//the only register of push, pop and idiv
+	Registers::Reg single_reg(const Instruction& ins){
+		return (ins.op == Opcodes::POP)?(ins.dst):(ins.src);
+	}
 
-//===========================================================================//
-//                                POP 
-//===========================================================================//
+	bool has_short_form(const Instruction& ins){
+		return ENCODINGS[ins.op].short_opcode != 0;
+	}
 
-	class PopReg: public Instruction {
-	private:
-		Registers::Reg dst;
-	
-	public:
-		PopReg(Registers::Reg dst): dst(dst){};
+	//is_short selects the rel8 form of a jump, see has_short_form
+	size_t size(const Instruction& ins, bool is_short = false){
+		const Encoding& enc = ENCODINGS[ins.op];
+
+		switch (enc.form){
+			case Format::NONE:    return 0;
+			case Format::FIXED:   return enc.opcode_size;
+			case Format::RR:
+			case Format::RR_REV:  return 2 + enc.opcode_size;
+			case Format::RI:      return imm_size(ins.imm);
+			case Format::MOV_RI:  return mov_imm_size(ins.dst, ins.imm);
+			case Format::ADDR:    return 7;
+			case Format::IMUL_RI: return (is_imm8(ins.imm))?(4):(7);
+			case Format::RM:      return 1 + enc.opcode_size + mem_size(ins.src, ins.index, ins.imm);
+			case Format::STORE:   return 1 + enc.opcode_size + mem_size(ins.dst, Registers::NOT_REG, ins.imm);
+			case Format::SHORT:   return (is_extended(single_reg(ins)))?(2):(1);
+			case Format::PUSH_I:  return (is_imm8(ins.imm))?(2):(5);
+			case Format::UNARY:   return 3;
+			case Format::REL:     return (is_short)?(2):(enc.opcode_size + 4);
+		}
+
+		return 0;
+	}
 
-		const char* assembly(){
-			static char output[128] = "";
-			sprintf(output, "\t\tpop %s", Registers::names[dst]); 
-			return output;
+	//rel is the distance from the end of a jump or call to its target
+	void encode(CodeBuffer& buf, const Instruction& ins, int32_t rel = 0, bool is_short = false){
+		const Encoding& enc = ENCODINGS[ins.op];
+		uint8_t* output = buf.append(size(ins, is_short));
+
+		//everything but mov r64, imm64 takes at most 32 bits
+		assert(ins.op == Opcodes::MOV_RI || is_imm32(ins.imm));
+		int32_t imm = (int32_t)ins.imm;
+
+		switch (enc.form){
+			case Format::NONE:
+				break;
+
+			case Format::FIXED:
+				memcpy(output, enc.opcode, enc.opcode_size);
+				break;
+
+			case Format::RR:
+				output[0] = rex(ins.src, Registers::NOT_REG, ins.dst);
+				memcpy(output + 1, enc.opcode, enc.opcode_size);
+				output[1 + enc.opcode_size] = reg_mask(0b11000000, ins.src, ins.dst);
+				break;
+
+			case Format::RR_REV:
+				output[0] = rex(ins.dst, Registers::NOT_REG, ins.src);
+				memcpy(output + 1, enc.opcode, enc.opcode_size);
+				output[1 + enc.opcode_size] = reg_mask(0b11000000, ins.dst, ins.src);
+				break;
+
+			case Format::RI:
+				encode_imm(output, enc.ext, ins.dst, imm);
+				break;
+
+			case Format::MOV_RI:
+				encode_mov_imm(output, ins.dst, ins.imm);
+				break;
+
+			case Format::ADDR:
+				output[0] = rex(Registers::NOT_REG, Registers::NOT_REG, ins.dst);
+				output[1] = enc.opcode[0];
+				output[2] = reg_mask(0b11000000, ins.dst);
+				memcpy(output + 3, &imm, 4);
+				break;
+
+			case Format::IMUL_RI:
+				output[0] = rex(ins.dst, Registers::NOT_REG, ins.src);
+				output[1] = (is_imm8(ins.imm))?(Binary::OP::IMUL_IMM8):(Binary::OP::IMUL_IMM32);
+				output[2] = reg_mask(0b11000000, ins.dst, ins.src);
+
+				if (is_imm8(ins.imm)) output[3] = (uint8_t)imm;
+				else                  memcpy(output + 3, &imm, 4);
+				break;
+
+			case Format::RM:
+				output[0] = rex(ins.dst, ins.index, ins.src);
+				memcpy(output + 1, enc.opcode, enc.opcode_size);
+				encode_mem(output + 1 + enc.opcode_size, Registers::codes[ins.dst], ins.src, ins.index, imm);
+				break;
+
+			case Format::STORE:
+				output[0] = rex(ins.src, Registers::NOT_REG, ins.dst);
+				memcpy(output + 1, enc.opcode, enc.opcode_size);
+				encode_mem(output + 1 + enc.opcode_size, Registers::codes[ins.src], ins.dst, Registers::NOT_REG, imm);
+				break;
+
+			case Format::SHORT:
+				if (is_extended(single_reg(ins))) *(output++) = Binary::REX::B;
+				*output = reg_mask(enc.opcode[0], single_reg(ins));
+				break;
+
+			case Format::PUSH_I:
+				if (is_imm8(ins.imm)){
+					output[0] = Binary::PUSH::NUM8;
+					output[1] = (uint8_t)imm;
+					break;
+				}
+
+				output[0] = enc.opcode[0];
+				memcpy(output + 1, &imm, 4);
+				break;
+
+			case Format::UNARY:
+				output[0] = rex(Registers::NOT_REG, Registers::NOT_REG, ins.src);
+				output[1] = enc.opcode[0];
+				output[2] = reg_mask(0b11000000 | (enc.ext << 3), ins.src);
+				break;
+
+			case Format::REL:
+				if (is_short){
+					assert(enc.short_opcode != 0 && is_imm8(rel));
+
+					output[0] = enc.short_opcode;
+					output[1] = (uint8_t)rel;
+					break;
+				}
+
+				memcpy(output, enc.opcode, enc.opcode_size);
+				memcpy(output + enc.opcode_size, &rel, 4);
+				break;
 		}
+	}
 
-		size_t size(){
-				return 1;
-		}
+	//name of the label an instruction defines or refers to
+	const char* target(char* output, const Instruction& ins, SymbolTable& symbols){
+		if (symbols.is_named(ins.label)) return symbols.name(ins.label);
 
-		const uint8_t* elf(){
-			static uint8_t output[1] = {0x90}; 
-			output[0] = reg_mask(Binary::POP::REG, dst);
+		sprintf(output, ".Block%d", ins.label);
+		return output;
+	}
 
-			return output;
-		}
-	};
+	//writes one line of NASM, output has to hold MAX_LINE characters
+	const char* assembly(char* output, const Instruction& ins, SymbolTable& symbols){
+		const Encoding& enc = ENCODINGS[ins.op];
+		const char* const* names = Registers::names;
+		char label[MAX_LINE] = "";
+
+		switch (enc.form){
+			case Format::NONE:
+				if (ins.op == Opcodes::LABEL) sprintf(output, "%s:", target(label, ins, symbols));
+				else                          output[0] = '\0';
+				break;
+
+			case Format::FIXED:
+				sprintf(output, "\t\t%s", enc.mnemonic);
+				break;
+
+			case Format::RR:
+			case Format::RR_REV:
+				sprintf(output, "\t\t%s %s, %s", enc.mnemonic, names[ins.dst], names[ins.src]);
+				break;
+
+			case Format::RI:
+			case Format::MOV_RI:
+				sprintf(output, "\t\t%s %s, %ld", enc.mnemonic, names[ins.dst], ins.imm);
+				break;
+
+			case Format::PUSH_I:
+				sprintf(output, "\t\t%s %ld", enc.mnemonic, ins.imm);
+				break;
+
+			case Format::ADDR:
+				sprintf(output, "\t\t%s %s, %s", enc.mnemonic, names[ins.dst], target(label, ins, symbols));
+				break;
+
+			case Format::IMUL_RI:
+				sprintf(output, "\t\t%s %s, %s, %ld", enc.mnemonic, names[ins.dst], names[ins.src], ins.imm);
+				break;
+
+			case Format::RM:
+				if (ins.index != Registers::NOT_REG){
+					sprintf(output, "\t\t%s %s, [%s + %s]", enc.mnemonic, names[ins.dst], names[ins.src], names[ins.index]);
+				}
+
+				else {
+					sprintf(output, "\t\t%s %s, [%s + %ld]", enc.mnemonic, names[ins.dst], names[ins.src], ins.imm);
+				}
+				break;
+
+			case Format::STORE:
+				sprintf(output, "\t\t%s [%s + %ld], %s", enc.mnemonic, names[ins.dst], ins.imm, names[ins.src]);
+				break;
+
+			case Format::SHORT:
+			case Format::UNARY:
+				sprintf(output, "\t\t%s %s", enc.mnemonic, names[single_reg(ins)]);
+				break;
+
+			case Format::REL:
+				sprintf(output, "\t\t%s %s", enc.mnemonic, target(label, ins, symbols));
+				break;
+		}
+
+		return output;
+	}
 
 //===========================================================================//
-//                               LABEL 
+//                                CONSTRUCTORS
 //===========================================================================//
 
-	class Label: public Instruction {
-	private:
-		const char* name  = nullptr;
-		const int64_t num = -1;
-		int32_t offset = 0;
-	
-	public:
-		explicit Label(int64_t num): num(num) {} 
-		explicit Label(const char* name): name(name) {}
-		
-
-		const char* assembly(){
-			static char output[128] = "";
-			if (num == -1){
-				sprintf(output, "%s:", name); 
-			}
-			
-			else {
-				sprintf(output, ".Block%ld:", num); 
-			}
-
-			return output;
-		}
-
-		const char* string(){
-			char* output = new char[128]();
-			if (num == -1){
-				sprintf(output, "%s", name); 
-			}
-			
-			else {
-				sprintf(output, ".Block%ld", num); 
-			}
-
-			return output;
-		}
-
-		size_t size(){
-			return 0;
-		}
-
-		void set_offset(int32_t new_offset){
-			offset = new_offset;
-		}
-
-		Spec_t spec_type(){
-			return LABEL;
-		}
-	};
-
-	class Array: public Instruction {
-	private:
-		const char* name  = nullptr;
-		const char* val   = nullptr;
-	
-	public:
-		Array(const char* name, const char* val): name(name), val(val) {}
-		
-
-		const char* assembly(){
-			static char output[128] = "";
-			sprintf(output, "%s db %s", name, val); 
-			return output;
-		}
-	};
-
-	class Comment: public Instruction {
-	private:
-		const char* text = nullptr; 
-		const int64_t num = UNUSED;
-	
-	public:
-		explicit Comment(const char* text): text(text) {};
-		explicit Comment(int num): num(num) {};
-
-		const char* assembly(){
-
-			static char output[128] = "";
-			if (num == UNUSED){
-				sprintf(output, ";%s", text); 
-			}
-
-			else {
-				sprintf(output, ";.EndBlock%ld", num); 
-			}
-
-			return output;
-		}
-	};
-
-	class Syscall: public Instruction {
-	public:	
-		Syscall(){};
-		const char* assembly(){
-			static char output[128] = "\t\tsyscall";
-			return output;
-		}
-
-		size_t size(){
-			return 2;	
-		}
-
-		const uint8_t* elf(){
-			static uint8_t output[2] = {0x0F, 0x05}; 
-			return output;
-		}
-	};
-
-	class Section: public Instruction {
-	private:
-		const char* name;
-	
-	public:
-		Section(const char* name): name(name) {};
-		
-		const char* assembly(){
-			static char output[128] = "";
-			sprintf(output, "section %s", name);
-			
-			return output;
-		}
-	};
-
-	class Global: public Instruction {
-	private:
-		const char* name;
-	
-	public:
-		Global(const char* name): name(name) {};
-		
-		const char* assembly(){
-			static char output[128] = "";
-			sprintf(output, "\t\tglobal %s", name);
-			
-			return output;
-		}
-
-	};
-
-	class Extern: public Instruction {
-	private:
-		const char* name;
-	
-	public:
-		Extern(const char* name): name(name) {};
-		
-		const char* assembly(){
-			static char output[128] = "";
-			sprintf(output, "\t\textern %s", name);
-			
-			return output;
-		}
-
-	};
+	using Registers::Reg;
+
+	const Reg NO_REG = Registers::NOT_REG;
+
+	Instruction MovReg2Reg(Reg dst, Reg src)                {return {Opcodes::MOV_RR, dst, src};}
+	Instruction MovVal2Reg(Reg dst, int64_t val)            {return {Opcodes::MOV_RI, dst, NO_REG, NO_REG, NO_LABEL, val};}
+	Instruction MovMem2Reg(Reg dst, Reg base, int32_t disp) {return {Opcodes::LOAD, dst, base, NO_REG, NO_LABEL, disp};}
+	Instruction MovMem2Reg(Reg dst, Symbol label)           {return {Opcodes::LOAD_LABEL, dst, NO_REG, NO_REG, label.id};}
+	Instruction MovReg2Mem(Reg base, int32_t disp, Reg src) {return {Opcodes::STORE, base, src, NO_REG, NO_LABEL, disp};}
+
+	Instruction AddReg2Reg(Reg dst, Reg src)                {return {Opcodes::ADD_RR, dst, src};}
+	Instruction AddVal2Reg(Reg dst, int32_t val)            {return {Opcodes::ADD_RI, dst, NO_REG, NO_REG, NO_LABEL, val};}
+	Instruction AddMem2Reg(Reg dst, Reg base, int32_t disp) {return {Opcodes::ADD_RM, dst, base, NO_REG, NO_LABEL, disp};}
+	Instruction SubReg2Reg(Reg dst, Reg src)                {return {Opcodes::SUB_RR, dst, src};}
+	Instruction SubReg2Val(Reg dst, int32_t val)            {return {Opcodes::SUB_RI, dst, NO_REG, NO_REG, NO_LABEL, val};}
+	Instruction SubMem2Reg(Reg dst, Reg base, int32_t disp) {return {Opcodes::SUB_RM, dst, base, NO_REG, NO_LABEL, disp};}
+	Instruction MulReg2Reg(Reg dst, Reg src)                {return {Opcodes::IMUL_RR, dst, src};}
+	Instruction MulVal2Reg(Reg dst, Reg src, int32_t val)   {return {Opcodes::IMUL_RI, dst, src, NO_REG, NO_LABEL, val};}
+	Instruction MulMem2Reg(Reg dst, Reg base, int32_t disp) {return {Opcodes::IMUL_RM, dst, base, NO_REG, NO_LABEL, disp};}
+	Instruction Lea(Reg dst, Reg base, int32_t disp)        {return {Opcodes::LEA, dst, base, NO_REG, NO_LABEL, disp};}
+	Instruction Lea(Reg dst, Reg base, Reg index)           {return {Opcodes::LEA, dst, base, index};}
+	Instruction IdivReg(Reg src)                            {return {Opcodes::IDIV, NO_REG, src};}
+	Instruction Cqo()                                       {return {Opcodes::CQO};}
+	Instruction XorReg2Reg(Reg dst, Reg src)                {return {Opcodes::XOR_RR, dst, src};}
+
+	Instruction CmpReg2Reg(Reg dst, Reg src)                {return {Opcodes::CMP_RR, dst, src};}
+	Instruction CmpVal2Reg(Reg dst, int32_t val)            {return {Opcodes::CMP_RI, dst, NO_REG, NO_REG, NO_LABEL, val};}
+	Instruction CmpMem2Reg(Reg dst, Reg base, int32_t disp) {return {Opcodes::CMP_RM, dst, base, NO_REG, NO_LABEL, disp};}
+
+	Instruction PushReg(Reg src)                            {return {Opcodes::PUSH, NO_REG, src};}
+	Instruction PushVal(int32_t val)                        {return {Opcodes::PUSH_I, NO_REG, NO_REG, NO_REG, NO_LABEL, val};}
+	Instruction PopReg(Reg dst)                             {return {Opcodes::POP, dst};}
+
+	Instruction Jump(Opcodes::Op op, Symbol label)          {return {op, NO_REG, NO_REG, NO_REG, label.id};}
+
+	Instruction Jmp(Symbol label)                           {return Jump(Opcodes::JMP, label);}
+	Instruction Jz (Symbol label)                           {return Jump(Opcodes::JZ,  label);}
+	Instruction Jnz(Symbol label)                           {return Jump(Opcodes::JNZ, label);}
+	Instruction Jg (Symbol label)                           {return Jump(Opcodes::JG,  label);}
+	Instruction Jge(Symbol label)                           {return Jump(Opcodes::JGE, label);}
+	Instruction Jl (Symbol label)                           {return Jump(Opcodes::JL,  label);}
+	Instruction Jle(Symbol label)                           {return Jump(Opcodes::JLE, label);}
+	Instruction Call(Symbol label)                          {return Jump(Opcodes::CALL, label);}
+	Instruction Ret()                                       {return {Opcodes::RET};}
+	Instruction Syscall()                                   {return {Opcodes::SYSCALL};}
+
+	Instruction Label(Symbol label)                         {return Jump(Opcodes::LABEL, label);}
 }
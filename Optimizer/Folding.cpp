@@ -0,0 +1,294 @@
+#pragma once
+#include "Folding.hpp"
+
+namespace OptimizerNS {
+	bool is_number(ASTreeNS::ASTNode_t* node){
+		return node != nullptr && node->key.type == TokenizerNS::NUM;
+	}
+
+	int64_t number_value(ASTreeNS::ASTNode_t* node){
+		assert(is_number(node));
+
+		return strtoll(node->key.lexem, nullptr, 10);
+	}
+
+	void make_number(ASTreeNS::ASTNode_t* node, int64_t val){
+		assert(node != nullptr);
+
+		if (node->left()  != nullptr) node->left()->remove_subtree();
+		if (node->right() != nullptr) node->right()->remove_subtree();
+
+		node->attach_left(nullptr);
+		node->attach_right(nullptr);
+
+		char* lexem = new char[32]();
+		sprintf(lexem, "%ld", val);
+
+		node->key = TokenizerNS::Token(lexem, TokenizerNS::NUM, Operator::NOT_OP);
+	}
+
+	bool is_comparison(Operator::code code){
+		return code == Operator::EQL    || code == Operator::NEQL   ||
+		       code == Operator::LESS   || code == Operator::MORE   ||
+		       code == Operator::EQLESS || code == Operator::EQMORE;
+	}
+
+	bool compare(Operator::code code, int64_t lhs, int64_t rhs){
+		switch (code){
+			case Operator::EQL:    return lhs == rhs;
+			case Operator::NEQL:   return lhs != rhs;
+			case Operator::LESS:   return lhs <  rhs;
+			case Operator::MORE:   return lhs >  rhs;
+			case Operator::EQLESS: return lhs <= rhs;
+			case Operator::EQMORE: return lhs >= rhs;
+			default:
+				assert("Wrong comparison" && false);
+		}
+
+		return false;
+	}
+
+	bool contains(ASTreeNS::ASTNode_t* node, Operator::code code){
+		if (node == nullptr) return false;
+		if (node->key.code == code) return true;
+
+		return contains(node->left(), code) || contains(node->right(), code);
+	}
+
+	bool is_written(ASTreeNS::ASTNode_t* node, const char* var){
+		if (node == nullptr) return false;
+
+		if (node->key.code == Operator::ASSGN && strcmp(node->left()->key.lexem, var) == 0){
+			return true;
+		}
+
+		if ((node->key.code == Operator::READ || node->key.code == Operator::SQRT) &&
+		    node->right()->key.type == TokenizerNS::ID && strcmp(node->right()->key.lexem, var) == 0){
+			return true;
+		}
+
+		return is_written(node->left(), var) || is_written(node->right(), var);
+	}
+
+	size_t count_varlist(ASTreeNS::ASTNode_t* list){
+		size_t num = 0;
+
+		for (; list != nullptr && list->right() != nullptr; list = list->left()){
+			++num;
+		}
+
+		return num;
+	}
+
+	void rebuild_varlist(ASTreeNS::ASTNode_t* list, Vector<bool>& drop){
+		assert(list != nullptr);
+		assert(list->key.code == Operator::COMMA);
+
+		Vector<ASTreeNS::ASTNode_t*> kept;
+		size_t pos = 0;
+
+		for (ASTreeNS::ASTNode_t* comma = list; comma != nullptr && comma->right() != nullptr; comma = comma->left()){
+			if (!drop[pos++]) kept.push_back(comma->right());
+		}
+
+		for (size_t i = 0; i < kept.size(); ++i){
+			kept[i]->unattach_from_parent();
+		}
+
+		if (list->left()  != nullptr) list->left()->remove_subtree();
+		if (list->right() != nullptr) list->right()->remove_subtree();
+
+		list->attach_left(nullptr);
+		list->attach_right(nullptr);
+
+		ASTreeNS::ASTNode_t* comma = list;
+
+		for (size_t i = 0; i < kept.size(); ++i){
+			comma->attach_right(kept[i]);
+			if (i + 1 == kept.size()) break;
+
+			comma = comma->attach_left(new ASTreeNS::ASTNode_t(SPEC_VARLIST));
+		}
+	}
+
+	void replace_with_child(ASTreeNS::ASTNode_t* node, ASTreeNS::ASTNode_t* child){
+		assert(node != nullptr);
+		assert(child != nullptr && child->parent() == node);
+
+		ASTreeNS::ASTNode_t* other = (child->is_left())?(node->right()):(node->left());
+		ASTreeNS::ASTNode_t* left  = child->left();
+		ASTreeNS::ASTNode_t* right = child->right();
+
+		node->key = child->key;
+		node->attach_left(left);
+		node->attach_right(right);
+
+		child->attach_left(nullptr);
+		child->attach_right(nullptr);
+		child->remove_subtree();
+
+		if (other != nullptr) other->remove_subtree();
+	}
+
+	void simplify_identity(ASTreeNS::ASTNode_t* node, bool left_const){
+		assert(node != nullptr);
+
+		ASTreeNS::ASTNode_t* known = (left_const)?(node->left()):(node->right());
+		ASTreeNS::ASTNode_t* other = (left_const)?(node->right()):(node->left());
+		int64_t val = number_value(known);
+
+		switch (node->key.code){
+			case Operator::ADD:
+				if (val == 0) replace_with_child(node, other);
+				break;
+			case Operator::SUB:
+				if (val == 0 && !left_const) replace_with_child(node, other);
+				break;
+			case Operator::MUL:
+				if (val == 1) replace_with_child(node, other);
+				else if (val == 0) make_number(node, 0);
+				break;
+			case Operator::DIV:
+				if (val == 1 && !left_const) replace_with_child(node, other);
+				break;
+			default:
+				break;
+		}
+	}
+
+	bool fold_expression(ASTreeNS::ASTNode_t* node){
+		if (node == nullptr) return false;
+
+		bool left_const  = fold_expression(node->left());
+		bool right_const = fold_expression(node->right());
+
+		if (node->key.type == TokenizerNS::NUM) return true;
+		if (!left_const && !right_const) return false;
+
+		if (!left_const || !right_const){
+			simplify_identity(node, left_const);
+			return is_number(node);
+		}
+
+		int64_t lhs = number_value(node->left());
+		int64_t rhs = number_value(node->right());
+		int64_t val = 0;
+
+		switch (node->key.code){
+			case Operator::ADD:
+				val = lhs + rhs;
+				break;
+			case Operator::SUB:
+				val = lhs - rhs;
+				break;
+			case Operator::MUL:
+				val = lhs * rhs;
+				break;
+			case Operator::DIV:
+				if (rhs == 0) return false;
+				val = lhs / rhs;
+				break;
+			default:
+				return false;
+		}
+
+		if (val < INT32_MIN || val > INT32_MAX) return false;
+
+		make_number(node, val);
+		return true;
+	}
+
+	void remove_statement(ASTreeNS::ASTNode_t* holder){
+		assert(holder != nullptr);
+		assert(holder->key.code == Operator::BLOCK);
+
+		ASTreeNS::ASTNode_t* stmt = holder->right();
+		ASTreeNS::ASTNode_t* next = holder->left();
+
+		if (next != nullptr){
+			holder->attach_right(next->right());
+			holder->attach_left (next->left());
+
+			next->attach_left(nullptr);
+			next->attach_right(nullptr);
+			next->remove_subtree();
+		}
+
+		else {
+			holder->attach_right(nullptr);
+		}
+
+		if (stmt != nullptr) stmt->remove_subtree();
+	}
+
+	void fold_branch(ASTreeNS::ASTNode_t* holder, bool taken){
+		assert(holder != nullptr);
+		assert(holder->right()->key.code == Operator::IF);
+
+		ASTreeNS::ASTNode_t* branch = holder->right();
+		ASTreeNS::ASTNode_t* arm    = (taken)?(branch->right()->right()):(branch->right()->left());
+		ASTreeNS::ASTNode_t* next   = holder->left();
+
+		arm->unattach_from_parent();
+
+		if (arm->right() == nullptr){
+			holder->attach_right(nullptr);
+			remove_statement(holder);
+		}
+
+		else {
+			ASTreeNS::ASTNode_t* last = arm;
+			while (last->left() != nullptr) last = last->left();
+
+			holder->attach_right(arm->right());
+
+			if (last != arm){
+				last->attach_left(next);
+				holder->attach_left(arm->left());
+			}
+		}
+
+		arm->attach_left(nullptr);
+		arm->attach_right(nullptr);
+		arm->remove_subtree();
+
+		branch->remove_subtree();
+	}
+
+	void fold_block(ASTreeNS::ASTNode_t* block){
+		ASTreeNS::ASTNode_t* stmt = nullptr;
+
+		while (block != nullptr && block->right() != nullptr){
+			stmt = block->right();
+
+			switch (stmt->key.code){
+				case Operator::IF:
+					if (fold_expression(stmt->left()->left()) & fold_expression(stmt->left()->right())){
+						bool taken = compare(stmt->left()->key.code, number_value(stmt->left()->left()),
+						                                             number_value(stmt->left()->right()));
+
+						ASTreeNS::ASTNode_t* dropped = (taken)?(stmt->right()->left()):(stmt->right()->right());
+
+						if (!contains(dropped, Operator::DEC_VAR)){
+							fold_branch(block, taken);
+							continue;
+						}
+					}
+
+					fold_block(stmt->right()->right());
+					fold_block(stmt->right()->left());
+					break;
+
+				case Operator::DEC_FUNC:
+					fold_block(stmt->right()->right());
+					break;
+
+				default:
+					fold_expression(stmt->right());
+					break;
+			}
+
+			block = block->left();
+		}
+	}
+};
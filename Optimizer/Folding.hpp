@@ -0,0 +1,26 @@
+#pragma once
+#include "../Lib/CompLib.hpp"
+#include "../Frontend/ASTree.cpp"
+
+namespace OptimizerNS {
+	bool    is_number(ASTreeNS::ASTNode_t* node);
+	int64_t number_value(ASTreeNS::ASTNode_t* node);
+	void    make_number(ASTreeNS::ASTNode_t* node, int64_t val);
+
+	bool is_comparison(Operator::code code);
+	bool compare(Operator::code code, int64_t lhs, int64_t rhs);
+
+	bool contains(ASTreeNS::ASTNode_t* node, Operator::code code);
+	bool is_written(ASTreeNS::ASTNode_t* node, const char* var);
+
+	size_t count_varlist(ASTreeNS::ASTNode_t* list);
+	void   rebuild_varlist(ASTreeNS::ASTNode_t* list, Vector<bool>& drop);
+
+	void replace_with_child(ASTreeNS::ASTNode_t* node, ASTreeNS::ASTNode_t* child);
+	void simplify_identity(ASTreeNS::ASTNode_t* node, bool left_const);
+	void remove_statement(ASTreeNS::ASTNode_t* holder);
+
+	bool fold_expression(ASTreeNS::ASTNode_t* node);
+	void fold_branch(ASTreeNS::ASTNode_t* holder, bool taken);
+	void fold_block(ASTreeNS::ASTNode_t* block);
+};
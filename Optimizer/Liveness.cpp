@@ -0,0 +1,156 @@
+#pragma once
+#include "Liveness.hpp"
+
+namespace OptimizerNS {
+	Liveness::Liveness(const ASTreeNS::ASTree& tree): root_(tree.root()) {}
+
+	size_t Liveness::num_removed_stores() const {
+		return num_removed_stores_;
+	}
+
+	size_t Liveness::num_removed_decls() const {
+		return num_removed_decls_;
+	}
+
+	void Liveness::run(){
+		process_functions(root_);
+	}
+
+	void Liveness::process_functions(ASTreeNS::ASTNode_t* node){
+		if (node == nullptr) return;
+
+		if (node->key.code == Operator::DEC_FUNC){
+			ASTreeNS::ASTNode_t* body = node->right()->right();
+
+			live_block(body, VarSet());
+
+			VarSet refs;
+			collect_refs(body, refs);
+			remove_unused_decls(body, refs);
+		}
+
+		process_functions(node->left());
+		process_functions(node->right());
+	}
+
+	void Liveness::collect_uses(ASTreeNS::ASTNode_t* node, VarSet& live){
+		if (node == nullptr) return;
+
+		if (node->key.type == TokenizerNS::ID &&
+		    !(node->parent()->key.code == Operator::CALL && node->is_right())){
+			live.insert(node->key.lexem);
+		}
+
+		collect_uses(node->left(),  live);
+		collect_uses(node->right(), live);
+	}
+
+	void Liveness::collect_refs(ASTreeNS::ASTNode_t* node, VarSet& refs){
+		if (node == nullptr || node->key.code == Operator::DEC_VAR) return;
+
+		if (node->key.type == TokenizerNS::ID &&
+		    !(node->parent()->key.code == Operator::CALL && node->is_right())){
+			refs.insert(node->key.lexem);
+		}
+
+		collect_refs(node->left(),  refs);
+		collect_refs(node->right(), refs);
+	}
+
+	VarSet Liveness::live_block(ASTreeNS::ASTNode_t* block, const VarSet& live_out){
+		Vector<ASTreeNS::ASTNode_t*> holders;
+
+		for (; block != nullptr && block->right() != nullptr; block = block->left()){
+			holders.push_back(block);
+		}
+
+		VarSet live = live_out;
+
+		for (size_t i = holders.size(); i > 0; --i){
+			live_statement(holders[i - 1], live);
+		}
+
+		return live;
+	}
+
+	void Liveness::live_statement(ASTreeNS::ASTNode_t* holder, VarSet& live){
+		assert(holder != nullptr);
+
+		ASTreeNS::ASTNode_t* stmt = holder->right();
+
+		switch (stmt->key.code){
+			case Operator::ASSGN:
+				if (live.count(stmt->left()->key.lexem) == 0){
+					++num_removed_stores_;
+
+					if (stmt->right()->key.code != Operator::CALL){
+						remove_statement(holder);
+						break;
+					}
+
+					ASTreeNS::ASTNode_t* call = stmt->right();
+					call->unattach_from_parent();
+					holder->attach_right(call);
+					stmt->remove_subtree();
+
+					collect_uses(call->left(), live);
+					break;
+				}
+
+				live.erase(stmt->left()->key.lexem);
+				collect_uses(stmt->right(), live);
+				break;
+
+			case Operator::READ:
+				live.erase(stmt->right()->key.lexem);
+				break;
+
+			case Operator::RETURN:
+				live.clear();
+				collect_uses(stmt->right(), live);
+				break;
+
+			case Operator::EXIT:
+				live.clear();
+				break;
+
+			case Operator::IF: {
+				VarSet then_live = live_block(stmt->right()->right(), live);
+				VarSet else_live = live_block(stmt->right()->left(),  live);
+
+				live = then_live;
+				live.insert(else_live.begin(), else_live.end());
+
+				collect_uses(stmt->left(), live);
+				break;
+			}
+
+			case Operator::DEC_VAR:
+			case Operator::DEC_FUNC:
+				break;
+
+			default:
+				collect_uses(stmt, live);
+				break;
+		}
+	}
+
+	void Liveness::remove_unused_decls(ASTreeNS::ASTNode_t* block, const VarSet& refs){
+		while (block != nullptr && block->right() != nullptr){
+			ASTreeNS::ASTNode_t* stmt = block->right();
+
+			if (stmt->key.code == Operator::DEC_VAR && refs.count(stmt->right()->key.lexem) == 0){
+				++num_removed_decls_;
+				remove_statement(block);
+				continue;
+			}
+
+			if (stmt->key.code == Operator::IF){
+				remove_unused_decls(stmt->right()->right(), refs);
+				remove_unused_decls(stmt->right()->left(),  refs);
+			}
+
+			block = block->left();
+		}
+	}
+};
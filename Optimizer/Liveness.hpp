@@ -0,0 +1,31 @@
+#pragma once
+#include "../Lib/CompLib.hpp"
+#include "../Frontend/ASTree.cpp"
+#include "Folding.cpp"
+
+namespace OptimizerNS {
+	using VarSet = std::set<const char*, str_less>;
+
+	class Liveness {
+	private:
+		ASTreeNS::ASTNode_t* root_ = nullptr;
+
+		size_t num_removed_stores_ = 0;
+		size_t num_removed_decls_  = 0;
+
+		void process_functions(ASTreeNS::ASTNode_t* node);
+		void collect_uses(ASTreeNS::ASTNode_t* node, VarSet& live);
+		void collect_refs(ASTreeNS::ASTNode_t* node, VarSet& refs);
+
+		VarSet live_block(ASTreeNS::ASTNode_t* block, const VarSet& live_out);
+		void   live_statement(ASTreeNS::ASTNode_t* holder, VarSet& live);
+		void   remove_unused_decls(ASTreeNS::ASTNode_t* block, const VarSet& refs);
+
+	public:
+		explicit Liveness(const ASTreeNS::ASTree& tree);
+
+		void run();
+		size_t num_removed_stores() const;
+		size_t num_removed_decls() const;
+	};
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include "Profile.hpp"
+
+namespace OptimizerNS {
+	bool Profile::load(const char* filename){
+		assert(filename != nullptr);
+
+		FILE* profile_f = fopen(filename, "r");
+		if (profile_f == nullptr) return false;
+
+		unsigned line = 0;
+		unsigned site = 0;
+		unsigned long count = 0;
+		char kind[16] = "";
+
+		while (fscanf(profile_f, "%u %u %15s %lu", &line, &site, kind, &count) == 4){
+			if (line >= Counter::MAX_LINES || site >= Counter::MAX_SITES) continue;
+
+			for (uint32_t i = 0; i < Counter::NUM_KINDS; ++i){
+				if (strcmp(kind, Counter::KIND_NAMES[i]) == 0) counts[Counter::key(line, site, (Counter::Kind)i)] += count;
+			}
+		}
+
+		fclose(profile_f);
+		return true;
+	}
+
+	bool Profile::has(uint32_t line, uint32_t site, Counter::Kind kind) const {
+		return counts.find(Counter::key(line, site, kind)) != counts.end();
+	}
+
+	uint64_t Profile::count(uint32_t line, uint32_t site, Counter::Kind kind) const {
+		auto found = counts.find(Counter::key(line, site, kind));
+
+		return (found == counts.end())?(0):(found->second);
+	}
+
+	bool Profile::is_cold(uint32_t line, uint32_t site, Counter::Kind kind, uint64_t entries) const {
+		return entries != 0 && count(line, site, kind) * Profiling::COLD_RATIO < entries;
+	}
+
+	size_t Profile::size() const {
+		return counts.size();
+	}
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include "../Lib/CompLib.hpp"
+#include "../Lib/Runtime.hpp"
+
+namespace OptimizerNS {
+	namespace Profiling {
+		constexpr uint64_t COLD_RATIO = 100; //a block is cold when it runs this many times less than its Theurgy
+	};
+
+	// Counts an instrumented build merged into Counter::FILE_NAME, by source line, site and kind,
+	// so they still apply after the code around them has changed.
+	class Profile {
+	private:
+		std::map<uint32_t, uint64_t> counts;
+
+	public:
+		Profile() = default;
+
+		bool load(const char* filename);
+
+		bool has(uint32_t line, uint32_t site, Counter::Kind kind) const;
+		uint64_t count(uint32_t line, uint32_t site, Counter::Kind kind) const;
+
+		//a Criterion arm, compared with the count of the Theurgy around it
+		bool is_cold(uint32_t line, uint32_t site, Counter::Kind kind, uint64_t entries) const;
+
+		size_t size() const;
+	};
+};
@@ -0,0 +1,297 @@
+#pragma once
+#include "Ranges.hpp"
+
+namespace OptimizerNS {
+	Range range_join(const Range& lhs, const Range& rhs){
+		if (lhs.is_empty()) return rhs;
+		if (rhs.is_empty()) return lhs;
+
+		return Range((lhs.lo < rhs.lo)?(lhs.lo):(rhs.lo), (lhs.hi > rhs.hi)?(lhs.hi):(rhs.hi));
+	}
+
+	Range range_meet(const Range& lhs, const Range& rhs){
+		return Range((lhs.lo > rhs.lo)?(lhs.lo):(rhs.lo), (lhs.hi < rhs.hi)?(lhs.hi):(rhs.hi));
+	}
+
+	Operator::code negate_comparison(Operator::code code){
+		switch (code){
+			case Operator::EQL:    return Operator::NEQL;
+			case Operator::NEQL:   return Operator::EQL;
+			case Operator::LESS:   return Operator::EQMORE;
+			case Operator::EQMORE: return Operator::LESS;
+			case Operator::MORE:   return Operator::EQLESS;
+			case Operator::EQLESS: return Operator::MORE;
+			default:
+				assert("Wrong comparison" && false);
+		}
+
+		return Operator::NOT_OP;
+	}
+
+	Operator::code swap_comparison(Operator::code code){
+		switch (code){
+			case Operator::LESS:   return Operator::MORE;
+			case Operator::MORE:   return Operator::LESS;
+			case Operator::EQLESS: return Operator::EQMORE;
+			case Operator::EQMORE: return Operator::EQLESS;
+			default:               return code;
+		}
+	}
+
+	RangeAnalysis::RangeAnalysis(const ASTreeNS::ASTree& tree): root_(tree.root()) {}
+
+	size_t RangeAnalysis::num_folded() const {
+		return num_folded_;
+	}
+
+	void RangeAnalysis::run(){
+		process_functions(root_);
+	}
+
+	void RangeAnalysis::process_functions(ASTreeNS::ASTNode_t* node){
+		if (node == nullptr) return;
+
+		if (node->key.code == Operator::DEC_FUNC){
+			RangeState state;
+			analyze_block(node->right()->right(), state);
+		}
+
+		process_functions(node->left());
+		process_functions(node->right());
+	}
+
+	Range RangeAnalysis::eval(ASTreeNS::ASTNode_t* node, const RangeState& state){
+		assert(node != nullptr);
+
+		if (is_number(node)){
+			return Range(number_value(node), number_value(node));
+		}
+
+		if (node->key.type == TokenizerNS::ID){
+			auto found = state.find(node->key.lexem);
+			return (found != state.end())?(found->second):(Range());
+		}
+
+		if (node->key.code != Operator::ADD && node->key.code != Operator::SUB &&
+		    node->key.code != Operator::MUL && node->key.code != Operator::DIV){
+			return Range();
+		}
+
+		Range lhs = eval(node->left(),  state);
+		Range rhs = eval(node->right(), state);
+		Range val(INT64_MAX, INT64_MIN);
+
+		int64_t lhs_bounds[2] = {lhs.lo, lhs.hi};
+		int64_t rhs_bounds[2] = {rhs.lo, rhs.hi};
+		int64_t corner = 0;
+
+		if (node->key.code == Operator::DIV && (rhs.lo <= 0 && rhs.hi >= 0)){
+			return Range();
+		}
+
+		for (int i = 0; i < 2; ++i){
+			for (int j = 0; j < 2; ++j){
+				bool overflow = false;
+
+				switch (node->key.code){
+					case Operator::ADD:
+						overflow = __builtin_add_overflow(lhs_bounds[i], rhs_bounds[j], &corner);
+						break;
+					case Operator::SUB:
+						overflow = __builtin_sub_overflow(lhs_bounds[i], rhs_bounds[j], &corner);
+						break;
+					case Operator::MUL:
+						overflow = __builtin_mul_overflow(lhs_bounds[i], rhs_bounds[j], &corner);
+						break;
+					default:
+						overflow = (lhs_bounds[i] == INT64_MIN && rhs_bounds[j] == -1);
+						if (!overflow) corner = lhs_bounds[i] / rhs_bounds[j];
+						break;
+				}
+
+				if (overflow) return Range();
+
+				val = range_join(val, Range(corner, corner));
+			}
+		}
+
+		return val;
+	}
+
+	//1 - always taken, 0 - never taken, -1 - unknown
+	int RangeAnalysis::decide(ASTreeNS::ASTNode_t* cond, const RangeState& state){
+		assert(cond != nullptr);
+
+		Range lhs = eval(cond->left(),  state);
+		Range rhs = eval(cond->right(), state);
+
+		switch (cond->key.code){
+			case Operator::MORE:
+				if (lhs.lo >  rhs.hi) return 1;
+				if (lhs.hi <= rhs.lo) return 0;
+				break;
+			case Operator::EQMORE:
+				if (lhs.lo >= rhs.hi) return 1;
+				if (lhs.hi <  rhs.lo) return 0;
+				break;
+			case Operator::LESS:
+				if (lhs.hi <  rhs.lo) return 1;
+				if (lhs.lo >= rhs.hi) return 0;
+				break;
+			case Operator::EQLESS:
+				if (lhs.hi <= rhs.lo) return 1;
+				if (lhs.lo >  rhs.hi) return 0;
+				break;
+			case Operator::EQL:
+				if (lhs.is_point() && rhs.is_point() && lhs.lo == rhs.lo) return 1;
+				if (lhs.hi < rhs.lo || lhs.lo > rhs.hi) return 0;
+				break;
+			case Operator::NEQL:
+				if (lhs.is_point() && rhs.is_point() && lhs.lo == rhs.lo) return 0;
+				if (lhs.hi < rhs.lo || lhs.lo > rhs.hi) return 1;
+				break;
+			default:
+				break;
+		}
+
+		return -1;
+	}
+
+	bool RangeAnalysis::refine_var(ASTreeNS::ASTNode_t* var, Operator::code code, const Range& bound, RangeState& state){
+		assert(var != nullptr);
+
+		if (var->key.type != TokenizerNS::ID) return true;
+
+		Range cur = eval(var, state);
+
+		switch (code){
+			case Operator::LESS:
+				if (bound.hi == INT64_MIN) return false;
+				cur = range_meet(cur, Range(INT64_MIN, bound.hi - 1));
+				break;
+			case Operator::EQLESS:
+				cur = range_meet(cur, Range(INT64_MIN, bound.hi));
+				break;
+			case Operator::MORE:
+				if (bound.lo == INT64_MAX) return false;
+				cur = range_meet(cur, Range(bound.lo + 1, INT64_MAX));
+				break;
+			case Operator::EQMORE:
+				cur = range_meet(cur, Range(bound.lo, INT64_MAX));
+				break;
+			case Operator::EQL:
+				cur = range_meet(cur, bound);
+				break;
+			case Operator::NEQL:
+				if (bound.is_point() && cur.lo == bound.lo) ++cur.lo;
+				else if (bound.is_point() && cur.hi == bound.lo) --cur.hi;
+				break;
+			default:
+				break;
+		}
+
+		state[var->key.lexem] = cur;
+		return !cur.is_empty();
+	}
+
+	bool RangeAnalysis::refine(ASTreeNS::ASTNode_t* cond, bool taken, RangeState& state){
+		assert(cond != nullptr);
+
+		Operator::code code = (taken)?(cond->key.code):(negate_comparison(cond->key.code));
+
+		Range lhs = eval(cond->left(),  state);
+		Range rhs = eval(cond->right(), state);
+
+		return refine_var(cond->left(),  code, rhs, state) &&
+		       refine_var(cond->right(), swap_comparison(code), lhs, state);
+	}
+
+	bool RangeAnalysis::analyze_branch(ASTreeNS::ASTNode_t* holder, RangeState& state, bool& reachable){
+		assert(holder != nullptr);
+
+		ASTreeNS::ASTNode_t* branch = holder->right();
+		ASTreeNS::ASTNode_t* cond   = branch->left();
+
+		RangeState then_state = state;
+		RangeState else_state = state;
+
+		bool then_feasible = refine(cond, true,  then_state);
+		bool else_feasible = refine(cond, false, else_state);
+
+		int outcome = decide(cond, state);
+
+		if (outcome == -1 && then_feasible != else_feasible){
+			outcome = then_feasible;
+		}
+
+		if (outcome != -1){
+			ASTreeNS::ASTNode_t* dropped = (outcome)?(branch->right()->left()):(branch->right()->right());
+
+			if (!contains(dropped, Operator::DEC_VAR)){
+				fold_branch(holder, outcome);
+				++num_folded_;
+				return true;
+			}
+		}
+
+		bool then_reachable = analyze_block(branch->right()->right(), then_state);
+		bool else_reachable = analyze_block(branch->right()->left(),  else_state);
+
+		if (then_reachable && else_reachable){
+			for (auto& var: else_state){
+				auto found = then_state.find(var.first);
+				if (found != then_state.end()) found->second = range_join(found->second, var.second);
+			}
+
+			for (auto var = then_state.begin(); var != then_state.end(); ){
+				if (else_state.count(var->first) == 0) var = then_state.erase(var);
+				else ++var;
+			}
+
+			state = then_state;
+		}
+
+		else if (then_reachable) state = then_state;
+		else if (else_reachable) state = else_state;
+
+		reachable = then_reachable || else_reachable;
+		return false;
+	}
+
+	bool RangeAnalysis::analyze_block(ASTreeNS::ASTNode_t* block, RangeState& state){
+		ASTreeNS::ASTNode_t* stmt = nullptr;
+		bool reachable = true;
+
+		while (block != nullptr && block->right() != nullptr){
+			stmt = block->right();
+
+			switch (stmt->key.code){
+				case Operator::ASSGN:
+					state[stmt->left()->key.lexem] = eval(stmt->right(), state);
+					break;
+
+				case Operator::READ:
+				case Operator::SQRT:
+				case Operator::DEC_VAR:
+					if (stmt->right()->key.type == TokenizerNS::ID) state.erase(stmt->right()->key.lexem);
+					break;
+
+				case Operator::RETURN:
+				case Operator::EXIT:
+					return false;
+
+				case Operator::IF:
+					if (analyze_branch(block, state, reachable)) continue;
+					if (!reachable) return false;
+					break;
+
+				default:
+					break;
+			}
+
+			block = block->left();
+		}
+
+		return true;
+	}
+};
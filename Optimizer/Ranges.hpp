@@ -0,0 +1,45 @@
+#pragma once
+#include "../Lib/CompLib.hpp"
+#include "../Frontend/ASTree.cpp"
+#include "Folding.cpp"
+
+namespace OptimizerNS {
+	struct Range {
+		int64_t lo = INT64_MIN;
+		int64_t hi = INT64_MAX;
+
+		Range() = default;
+		Range(int64_t lo, int64_t hi): lo(lo), hi(hi) {}
+
+		bool is_empty() const { return lo > hi; }
+		bool is_point() const { return lo == hi; }
+	};
+
+	Range range_join(const Range& lhs, const Range& rhs);
+	Range range_meet(const Range& lhs, const Range& rhs);
+
+	using RangeState = std::map<const char*, Range, str_less>;
+
+	class RangeAnalysis {
+	private:
+		ASTreeNS::ASTNode_t* root_ = nullptr;
+
+		size_t num_folded_ = 0;
+
+		void process_functions(ASTreeNS::ASTNode_t* node);
+
+		Range eval(ASTreeNS::ASTNode_t* node, const RangeState& state);
+		int   decide(ASTreeNS::ASTNode_t* cond, const RangeState& state);
+		bool  refine(ASTreeNS::ASTNode_t* cond, bool taken, RangeState& state);
+		bool  refine_var(ASTreeNS::ASTNode_t* var, Operator::code code, const Range& bound, RangeState& state);
+
+		bool analyze_block(ASTreeNS::ASTNode_t* block, RangeState& state);
+		bool analyze_branch(ASTreeNS::ASTNode_t* holder, RangeState& state, bool& reachable);
+
+	public:
+		explicit RangeAnalysis(const ASTreeNS::ASTree& tree);
+
+		void run();
+		size_t num_folded() const;
+	};
+};
@@ -0,0 +1,218 @@
+#pragma once
+#include "Specializer.hpp"
+
+namespace OptimizerNS {
+	Specializer::Specializer(const ASTreeNS::ASTree& tree, const Profile* profile): root_(tree.root()), profile_(profile) {}
+
+	Specializer::~Specializer(){
+		for (auto& pattern: patterns){
+			delete [] pattern.first;
+			delete pattern.second;
+		}
+	}
+
+	size_t Specializer::num_clones() const {
+		return num_clones_;
+	}
+
+	void Specializer::run(){
+		collect_functions(root_);
+		collect_calls(root_);
+
+		for (auto& func: functions){
+			specialize(func.second);
+		}
+	}
+
+	void Specializer::collect_functions(ASTreeNS::ASTNode_t* node){
+		if (node == nullptr) return;
+
+		if (node->key.code == Operator::DEC_FUNC){
+			functions[node->right()->key.lexem] = node;
+		}
+
+		collect_functions(node->left());
+		collect_functions(node->right());
+	}
+
+	void Specializer::collect_calls(ASTreeNS::ASTNode_t* node){
+		if (node == nullptr) return;
+
+		if (node->key.code == Operator::CALL){
+			auto func = functions.find(node->right()->key.lexem);
+			if (func != functions.end()) add_call(node, func->second);
+		}
+
+		collect_calls(node->left());
+		collect_calls(node->right());
+	}
+
+	void Specializer::add_call(ASTreeNS::ASTNode_t* call, ASTreeNS::ASTNode_t* func){
+		assert(call != nullptr);
+		assert(func != nullptr);
+
+		if (count_varlist(call->left()) != count_varlist(func->left())) return;
+
+		char key[Consts::BUF_SIZE] = "";
+		int  key_len = sprintf(key, "%s(", func->right()->key.lexem);
+
+		Vector<const char*> values;
+		bool has_consts = false;
+
+		ASTreeNS::ASTNode_t* arg   = call->left();
+		ASTreeNS::ASTNode_t* param = func->left();
+
+		for (; arg != nullptr && arg->right() != nullptr; arg = arg->left(), param = param->left()){
+			if (is_number(arg->right()) && !is_written(func->right()->right(), param->right()->key.lexem)){
+				key_len += snprintf(key + key_len, sizeof(key) - key_len, "%s,", arg->right()->key.lexem);
+				values.push_back(arg->right()->key.lexem);
+				has_consts = true;
+			}
+
+			else {
+				key_len += snprintf(key + key_len, sizeof(key) - key_len, "_,");
+				values.push_back(nullptr);
+			}
+
+			if (key_len >= (int)sizeof(key)) return;
+		}
+
+		if (!has_consts) return;
+
+		auto found = patterns.find(key);
+		CallPattern* pattern = nullptr;
+
+		if (found == patterns.end()){
+			pattern = new CallPattern();
+			pattern->func = func;
+			pattern->key  = strcpy(new char[key_len + 1], key);
+
+			for (size_t i = 0; i < values.size(); ++i){
+				pattern->values.push_back(values[i]);
+			}
+
+			patterns[pattern->key] = pattern;
+		}
+
+		else {
+			pattern = found->second;
+		}
+
+		pattern->sites.push_back(call);
+	}
+
+	void Specializer::specialize(ASTreeNS::ASTNode_t* func){
+		assert(func != nullptr);
+
+		Vector<CallPattern*> candidates;
+
+		//a Theurgy that ran in the profile is cloned only for sites that called it there,
+		//otherwise only for patterns seen at MIN_CALLS sites or more
+		bool is_profiled = profile_ != nullptr && profile_->count(func->key.line, func->key.site, Counter::BODY) != 0;
+
+		for (auto& entry: patterns){
+			if (entry.second->func != func) continue;
+
+			if (is_profiled  && weight(entry.second, is_profiled) == 0) continue;
+			if (!is_profiled && entry.second->sites.size() < Specialization::MIN_CALLS) continue;
+
+			candidates.push_back(entry.second);
+		}
+
+		CallPattern* chosen[Specialization::MAX_CLONES] = {};
+		size_t num_chosen = 0;
+
+		for (; num_chosen < Specialization::MAX_CLONES && num_chosen < candidates.size(); ++num_chosen){
+			size_t best = num_chosen;
+
+			for (size_t i = num_chosen + 1; i < candidates.size(); ++i){
+				if (weight(candidates[i], is_profiled) > weight(candidates[best], is_profiled)) best = i;
+			}
+
+			chosen[num_chosen] = candidates[best];
+			candidates[best]   = candidates[num_chosen];
+		}
+
+		for (size_t i = 0; i < num_chosen; ++i){
+			ASTreeNS::ASTNode_t* copy = clone(chosen[i], i);
+			redirect(chosen[i], copy->right()->key.lexem);
+		}
+	}
+
+	// Calls made through the pattern's sites in the profile, the number of sites without one.
+	uint64_t Specializer::weight(CallPattern* pattern, bool is_profiled){
+		assert(pattern != nullptr);
+
+		if (!is_profiled) return pattern->sites.size();
+
+		uint64_t calls = 0;
+
+		for (size_t i = 0; i < pattern->sites.size(); ++i){
+			calls += profile_->count(pattern->sites[i]->key.line, pattern->sites[i]->key.site, Counter::CALL);
+		}
+
+		return calls;
+	}
+
+	ASTreeNS::ASTNode_t* Specializer::clone(CallPattern* pattern, size_t clone_num){
+		assert(pattern != nullptr);
+
+		ASTreeNS::ASTNode_t* func = pattern->func;
+		ASTreeNS::ASTNode_t* copy = func->copy_subtree();
+
+		const char* name = func->right()->key.lexem;
+		char* clone_name = new char[strlen(name) + 32]();
+		sprintf(clone_name, "%s.spec%zu", name, clone_num);
+		copy->right()->key.lexem = clone_name;
+
+		Vector<bool> drop;
+		size_t pos = 0;
+
+		for (ASTreeNS::ASTNode_t* param = copy->left(); param != nullptr && param->right() != nullptr; param = param->left()){
+			const char* val = pattern->values[pos++];
+			drop.push_back(val != nullptr);
+
+			if (val != nullptr) substitute(copy->right()->right(), param->right()->key.lexem, val);
+		}
+
+		rebuild_varlist(copy->left(), drop);
+		fold_block(copy->right()->right());
+
+		ASTreeNS::ASTNode_t* holder = func->parent();
+		ASTreeNS::ASTNode_t* new_holder = new ASTreeNS::ASTNode_t(SPEC_BLOCK);
+
+		new_holder->attach_right(copy);
+		new_holder->attach_left(holder->left());
+		holder->attach_left(new_holder);
+
+		++num_clones_;
+
+		return copy;
+	}
+
+	void Specializer::substitute(ASTreeNS::ASTNode_t* node, const char* var, const char* val){
+		if (node == nullptr) return;
+
+		if (node->key.type == TokenizerNS::ID && strcmp(node->key.lexem, var) == 0 &&
+		    !(node->parent()->key.code == Operator::CALL && node->is_right())){
+			node->key = TokenizerNS::Token(val, TokenizerNS::NUM, Operator::NOT_OP);
+		}
+
+		substitute(node->left(), var, val);
+		substitute(node->right(), var, val);
+	}
+
+	void Specializer::redirect(CallPattern* pattern, const char* clone_name){
+		assert(pattern != nullptr);
+
+		Vector<bool> drop;
+		for (size_t i = 0; i < pattern->values.size(); ++i){
+			drop.push_back(pattern->values[i] != nullptr);
+		}
+
+		for (size_t i = 0; i < pattern->sites.size(); ++i){
+			pattern->sites[i]->right()->key.lexem = clone_name;
+			rebuild_varlist(pattern->sites[i]->left(), drop);
+		}
+	}
+};
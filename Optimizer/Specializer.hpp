@@ -0,0 +1,48 @@
+#pragma once
+#include "../Lib/CompLib.hpp"
+#include "../Frontend/ASTree.cpp"
+#include "Folding.cpp"
+#include "Profile.cpp"
+
+namespace OptimizerNS {
+	namespace Specialization {
+		constexpr size_t MAX_CLONES = 4; //clones per Theurgy
+		constexpr size_t MIN_CALLS  = 2; //call sites sharing a pattern before it is cloned, without a profile
+	};
+
+	struct CallPattern {
+		const char* key = nullptr;
+		ASTreeNS::ASTNode_t* func = nullptr;
+
+		Vector<const char*> values;           //nullptr for arguments that stay variable
+		Vector<ASTreeNS::ASTNode_t*> sites;
+	};
+
+	class Specializer {
+	private:
+		ASTreeNS::ASTNode_t* root_ = nullptr;
+		const Profile* profile_ = nullptr;
+
+		std::map<const char*, ASTreeNS::ASTNode_t*, str_less> functions;
+		std::map<const char*, CallPattern*, str_less> patterns;
+
+		size_t num_clones_ = 0;
+
+		void collect_functions(ASTreeNS::ASTNode_t* node);
+		void collect_calls(ASTreeNS::ASTNode_t* node);
+		void add_call(ASTreeNS::ASTNode_t* call, ASTreeNS::ASTNode_t* func);
+
+		void specialize(ASTreeNS::ASTNode_t* func);
+		uint64_t weight(CallPattern* pattern, bool is_profiled);
+		ASTreeNS::ASTNode_t* clone(CallPattern* pattern, size_t clone_num);
+		void substitute(ASTreeNS::ASTNode_t* node, const char* var, const char* val);
+		void redirect(CallPattern* pattern, const char* clone_name);
+
+	public:
+		explicit Specializer(const ASTreeNS::ASTree& tree, const Profile* profile = nullptr);
+		~Specializer();
+
+		void run();
+		size_t num_clones() const;
+	};
+};
@@ -0,0 +1,206 @@
+// Tests of the runtime linker in Backend/ObjectFile.cpp. The objects are assembled from the sources
+// below with GNU as, so run them where binutils is installed, from the root of the repository:
+//
+//     g++ -std=c++17 -I. Tests/ObjectFile.cpp -o object_file_test && ./object_file_test
+//
+// Failing cases print the linker's own diagnostics on stderr, the verdicts go to stdout.
+#include "../Backend/ObjectFile.cpp"
+#include <stdio.h>
+
+namespace ObjectFileTest {
+	using CodeGeneratorNS::ObjectFile;
+
+	constexpr uint64_t BASE = 0x400000;
+	constexpr uint64_t FAR_BASE = 0x100000000; //absolute 32-bit fields no longer fit
+	constexpr size_t PAGE_SIZE = 0x1000;
+	constexpr size_t MAX_PATH = 128;
+
+	//.text referencing .data and .bss in every way the linker supports
+	constexpr const char* SECTIONS = R"(
+		.intel_syntax noprefix
+		.text
+		.globl load_value, load_counter, call_helper, abs32, abs32s, helper
+	load_value:   mov rax, qword ptr [rip + value]
+	load_counter: lea rcx, [rip + counter]
+	call_helper:  call helper@PLT
+	abs32:        mov edx, offset value
+	abs32s:       mov rdx, offset counter
+	helper:       ret
+
+		.data
+		.globl value, counter_ptr
+	value:        .quad 42
+	counter_ptr:  .quad counter + 8
+
+		.bss
+		.globl counter
+		.balign 16
+	counter:      .zero 64
+	)";
+
+	constexpr const char* GOT_LOAD = R"(
+		.intel_syntax noprefix
+		.text
+		mov rax, qword ptr [rip + value@GOTPCREL]
+		.data
+		.globl value
+	value: .quad 1
+	)";
+
+	constexpr const char* UNDEFINED = R"(
+		.intel_syntax noprefix
+		.text
+		call missing@PLT
+	)";
+
+	bool assemble(const char* name, const char* source, char* object){
+		char assembly[MAX_PATH] = "";
+		char command[3 * MAX_PATH] = "";
+
+		snprintf(assembly, MAX_PATH, "/tmp/aristotle_test_%s.s", name);
+		snprintf(object,   MAX_PATH, "/tmp/aristotle_test_%s.o", name);
+
+		FILE* output_f = fopen(assembly, "w");
+		if (output_f == nullptr) return false;
+
+		fputs(source, output_f);
+		fclose(output_f);
+
+		snprintf(command, sizeof(command), "as %s -o %s", assembly, object);
+		return system(command) == 0;
+	}
+
+	//the way write_exe lays out an image: read-only sections, then data and .bss from the next page
+	bool link(ObjectFile& object, CodeBuffer& image, uint64_t base, size_t& data_end){
+		object.place(image, false);
+
+		size_t padding = (PAGE_SIZE - image.size() % PAGE_SIZE) % PAGE_SIZE;
+		memset(image.append(padding), 0, padding);
+
+		object.place(image, true);
+		data_end = object.place_nobits(image.size());
+
+		return object.relocate(image, base);
+	}
+
+	template <typename T>
+	T field(CodeBuffer& image, uint64_t address){
+		T value = 0;
+		memcpy(&value, image.data() + (address - BASE), sizeof(T));
+
+		return value;
+	}
+
+	uint64_t address(ObjectFile& object, const char* name){
+		uint64_t found = 0;
+		if (!object.find(name, BASE, found)) return 0;
+
+		return found;
+	}
+
+	bool resolves_sections(){
+		char name[MAX_PATH] = "";
+		if (!assemble("sections", SECTIONS, name)) return false;
+
+		ObjectFile object;
+		if (!object.load(name)) return false;
+
+		CodeBuffer image;
+		size_t data_end = 0;
+		if (!link(object, image, BASE, data_end)) return false;
+
+		uint64_t value   = address(object, "value");
+		uint64_t counter = address(object, "counter");
+		uint64_t helper  = address(object, "helper");
+
+		uint64_t load_value   = address(object, "load_value");
+		uint64_t load_counter = address(object, "load_counter");
+		uint64_t call_helper  = address(object, "call_helper");
+
+		return value != 0 && counter != 0 && helper != 0 &&
+		       field<int64_t> (image, value) == 42 &&
+		       value >= BASE + PAGE_SIZE &&
+		       counter >= BASE + image.size() && counter % 16 == 0 && counter + 64 <= BASE + data_end &&
+		       field<int32_t> (image, load_value   + 3) == (int64_t)(value   - (load_value   + 7)) &&
+		       field<int32_t> (image, load_counter + 3) == (int64_t)(counter - (load_counter + 7)) &&
+		       field<int32_t> (image, call_helper  + 1) == (int64_t)(helper  - (call_helper  + 5)) &&
+		       field<uint32_t>(image, address(object, "abs32")  + 1) == value &&
+		       field<int32_t> (image, address(object, "abs32s") + 3) == (int64_t)counter &&
+		       field<uint64_t>(image, address(object, "counter_ptr")) == counter + 8;
+	}
+
+	bool rejects_out_of_range(){
+		char name[MAX_PATH] = "";
+		if (!assemble("sections", SECTIONS, name)) return false;
+
+		ObjectFile object;
+		if (!object.load(name)) return false;
+
+		CodeBuffer image;
+		size_t data_end = 0;
+
+		return !link(object, image, FAR_BASE, data_end);
+	}
+
+	bool rejects_unsupported_type(){
+		char name[MAX_PATH] = "";
+		if (!assemble("got_load", GOT_LOAD, name)) return false;
+
+		ObjectFile object;
+		if (!object.load(name)) return false;
+
+		CodeBuffer image;
+		size_t data_end = 0;
+
+		return !link(object, image, BASE, data_end);
+	}
+
+	bool rejects_undefined_symbol(){
+		char name[MAX_PATH] = "";
+		if (!assemble("undefined", UNDEFINED, name)) return false;
+
+		ObjectFile object;
+		if (!object.load(name)) return false;
+
+		CodeBuffer image;
+		size_t data_end = 0;
+
+		return !link(object, image, BASE, data_end);
+	}
+
+	bool rejects_non_object(){
+		char name[MAX_PATH] = "";
+		if (!assemble("sections", SECTIONS, name)) return false;
+
+		ObjectFile object;
+		return !object.load("/tmp/aristotle_test_sections.s"); //the source assemble() left behind
+	}
+
+	struct Test {
+		const char* name;
+		bool (*run)();
+	};
+
+	constexpr Test TESTS[] = {
+		{"resolves .text, .data and .bss", resolves_sections},
+		{"rejects out of range fields",    rejects_out_of_range},
+		{"rejects unsupported types",      rejects_unsupported_type},
+		{"rejects undefined symbols",      rejects_undefined_symbol},
+		{"rejects non-objects",            rejects_non_object},
+	};
+
+	constexpr size_t NUM_TESTS = sizeof(TESTS) / sizeof(TESTS[0]);
+};
+
+int main(){
+	size_t num_failed = 0;
+
+	for (size_t i = 0; i < ObjectFileTest::NUM_TESTS; ++i){
+		bool is_passed = ObjectFileTest::TESTS[i].run();
+		num_failed += !is_passed;
+
+		printf("%-8s %s\n", (is_passed)?("ok"):("FAILED"), ObjectFileTest::TESTS[i].name);
+	}
+
+	return num_failed != 0;
+}
@@ -46,7 +46,8 @@ namespace TokenizerNS {
 		}
 	}
 
-	Token::Token(const char* lexem, TokenizerNS::token_type type, Operator::code code): lexem(lexem), type(type), code(code){};
+	Token::Token(const char* lexem, TokenizerNS::token_type type, Operator::code code, uint32_t line, uint32_t site):
+		lexem(lexem), type(type), code(code), line(line), site(site){};
 
 	Tokenizer::Tokenizer(FILE* input_file){
 
@@ -57,6 +58,8 @@ namespace TokenizerNS {
 		
 		program = new char [file_size + 128 ]();
 		lexems  = new const char*[Consts::BUF_SIZE]();
+		uint32_t* lines = new uint32_t[Consts::BUF_SIZE]();
+		uint32_t line = 1;
 
 		setvbuf(input_file, nullptr, _IOFBF, file_size + 128);
 		fread(program, sizeof(char), file_size, input_file);
@@ -64,9 +67,13 @@ namespace TokenizerNS {
 		int offset = 0;
 
 		while (*program){
+			const char* spaces = program;
 			skip_spaces(&program);
+
+			for (; spaces != program; ++spaces) line += (*spaces == '\n');
 			if (!(*program)) break;
 
+			lines[num_tokens_] = line;
 			sscanf(program, "%ms%n", lexems++, &offset);
 			program += offset;
 			++num_tokens_;
@@ -79,7 +86,14 @@ namespace TokenizerNS {
 	
 		for (size_t i = 0; i < num_tokens_; ++i){
 			tokens_[i] = Token(lexems[i]);
+			tokens_[i].line = lines[i];
+
+			for (size_t j = i; j > 0 && lines[j - 1] == lines[i]; --j){
+				tokens_[i].site += tokens_[j - 1].code == tokens_[i].code;
+			}
 		}
+
+		delete [] lines;
 	}
 
 	Token* Tokenizer::tokens(){
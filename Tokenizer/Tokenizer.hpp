@@ -15,10 +15,12 @@ namespace TokenizerNS {
 		const char* lexem = nullptr;
 		token_type type = NIL;
 		Operator::code code = Operator::NOT_OP;
+		uint32_t line = 0; //in the source, from 1, 0 for nodes the parser makes up
+		uint32_t site = 0; //tokens of the same operator before it on its line, tells profile counters of one line apart
 
 		Token() = default;
 		Token(const char*);
-		Token(const char*, token_type, Operator::code);
+		Token(const char*, token_type, Operator::code, uint32_t line = 0, uint32_t site = 0);
 	};
 
 	class Tokenizer {
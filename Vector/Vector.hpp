@@ -13,6 +13,7 @@ public:
 
 	void push_back(const T& new_elem);
 	void reshape(size_t new_size);
+	void resize(size_t new_size);
 
 	size_t size();
 	size_t capacity();
@@ -44,6 +45,12 @@ void Vector<T>::reshape(size_t new_size){
 	max_size_ = new_size;
 }
 
+template <typename T>
+void Vector<T>::resize(size_t new_size){
+	reshape(new_size);
+	size_ = new_size;
+}
+
 template <typename T>
 void Vector<T>::push_back(const T& new_elem){
 	if (size_ == max_size_) reshape(2 * max_size_);
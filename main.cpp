@@ -1,13 +1,129 @@
 #include "Frontend/ASTree.cpp"
 #include "Tokenizer/Tokenizer.cpp"
+#include "Optimizer/Specializer.cpp"
+#include "Optimizer/Ranges.cpp"
+#include "Optimizer/Liveness.cpp"
 #include "Backend/CodeGenerator.cpp"
+#include "Backend/Jit.cpp"
+#include "Backend/Interpreter.cpp"
+#include "Backend/Bytecode.cpp"
+#include "Lib/Runtime.cpp"
 
 int main(int argc, const char* argv[]){
-	FILE* code = fopen((argc - 1 >= 1)?(argv[1]):("test.aristotle"), "r");
+	const char* filename = "test.aristotle";
+	const char* runtime  = CodeGeneratorNS::Linking::RUNTIME_OBJ;
+	bool print_stats = false;
+	bool emit_exe    = false;
+	bool emit_obj    = false;
+	bool run_jit     = false;
+	bool is_lazy     = false;
+	bool is_tiered   = false;
+	bool run_vm      = false;
+	bool perf_map    = false;
+	bool instrument  = false;
+	bool use_profile = false;
+
+	for (int i = 1; i < argc; ++i){
+		if      (strcmp(argv[i], "--stats")       == 0) print_stats = true;
+		else if (strcmp(argv[i], "--emit=exe")    == 0) emit_exe    = true;
+		else if (strcmp(argv[i], "--emit=obj")    == 0) emit_obj    = true;
+		else if (strcmp(argv[i], "--run")         == 0) run_jit     = true;
+		else if (strcmp(argv[i], "--lazy")        == 0) is_lazy     = true;
+		else if (strcmp(argv[i], "--tiered")      == 0) is_tiered   = true;
+		else if (strcmp(argv[i], "--vm")          == 0) run_vm      = true;
+		else if (strcmp(argv[i], "--perf-map")    == 0) perf_map    = true;
+		else if (strcmp(argv[i], "--instrument")  == 0) instrument  = true;
+		else if (strcmp(argv[i], "--profile-use") == 0) use_profile = true;
+		else if (strcmp(argv[i], "--emit=asm")    == 0) emit_exe    = emit_obj = false;
+		else if (strncmp(argv[i], "--runtime=", 10) == 0) runtime   = argv[i] + 10;
+		else filename = argv[i];
+	}
+
+	FILE* code = fopen(filename, "r");
 	TokenizerNS::Tokenizer t(code);
 	ASTreeNS::ASTree tree(t.tokens());	
+
+	//counts merged by earlier runs of an instrumented build
+	OptimizerNS::Profile profile;
+
+	if (use_profile && !profile.load(Counter::FILE_NAME)){
+		fprintf(stderr, "cannot read %s, run a build made with --instrument first\n", Counter::FILE_NAME);
+		return 1;
+	}
+
+	OptimizerNS::Specializer specializer(tree, (use_profile)?(&profile):(nullptr));
+	specializer.run();
+
+	OptimizerNS::RangeAnalysis ranges(tree);
+	ranges.run();
+
+	OptimizerNS::Liveness liveness(tree);
+	liveness.run();
+
 	tree.dump("dump.dot");
 
-	CodeGeneratorNS::CodeGenerator gen(tree);
-	gen.write("output.asm");
+	//no machine code at all, for hosts where pages cannot be made executable
+	if (run_vm){
+		CodeGeneratorNS::BytecodeVM vm(tree);
+		if (!vm.is_ready()) return 1;
+
+		printf("%ld\n", vm.run());
+
+		if (print_stats) vm.dump_stats(stdout);
+
+		return 0;
+	}
+
+	CodeGeneratorNS::CodeGenerator gen(tree, is_lazy || is_tiered, instrument, (use_profile)?(&profile):(nullptr));
+
+	//nothing is generated up front, Theurgies are compiled as they are first called or get hot
+	if (is_lazy || is_tiered){
+		CodeGeneratorNS::LazyJitCode jit(gen);
+		if (!jit.is_ready()) return 1;
+
+		CodeGeneratorNS::Jit::PerfMap map;
+		if (perf_map) jit.set_perf_map(map);
+
+		if (is_tiered){
+			CodeGeneratorNS::Interpreter interpreter(tree, jit);
+			if (!interpreter.is_ready()) return 1;
+
+			printf("%ld\n", interpreter.run());
+
+			if (print_stats) interpreter.dump_stats(stdout);
+		}
+
+		else {
+			long result = 0;
+			if (!jit.run(result)) return 1;
+
+			printf("%ld\n", result);
+
+			if (print_stats) printf("compiled Theurgies: %zu\n", jit.compiled());
+		}
+
+		return 0;
+	}
+
+	gen.write_asm("output.asm");
+
+	if (emit_exe && !gen.write_exe("output", runtime))    return 1;
+	if (emit_obj && !gen.write_obj("output.o", filename)) return 1;
+
+	if (run_jit){
+		CodeGeneratorNS::JitCode jit(gen);
+		if (!jit.is_ready()) return 1;
+
+		if (perf_map){
+			CodeGeneratorNS::Jit::PerfMap map;
+			jit.write_perf_map(map);
+		}
+
+		long result = 0;
+		if (!jit.run(result)) return 1;
+
+		printf("%ld\n", result);
+	}
+
+	if (print_stats) gen.dump_stats(stdout);
 }
@@ -0,0 +1,14 @@
+section .text
+		global _start
+_start:
+		push rbp
+		mov rbp, rsp
+		sub rsp, 16
+		mov [rbp + -8], rbx
+		mov rbx, 3
+		lea r10, [rbx + 1]
+		mov rax, r10
+		mov rbx, [rbp + -8]
+		mov rsp, rbp
+		pop rbp
+		ret